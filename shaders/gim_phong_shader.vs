@@ -0,0 +1,48 @@
+#version 330 core
+
+// Variant of phong_shader.vs for geometry images: there are no vertex attributes.
+// Each vertex is a pixel of the geometry image (gl_VertexID = y * width + x) and its position is fetched from gimPositions.
+
+out vec4 fragmentPosition;
+out vec4 fragmentNormal;
+out vec2 fragmentTextureCoords;
+
+uniform mat4 modelMatrix;
+uniform mat4 viewMatrix;
+uniform mat4 projectionMatrix;
+uniform sampler2D gimPositions;
+
+// Pixels outside the image continue on the other side of the spherical geometry image border:
+// (-x, y) is the same as (x, h - 1 - y) and (x, -y) is the same as (w - 1 - x, y)
+vec3 fetchPosition(ivec2 pixel, ivec2 size)
+{
+	if (pixel.x < 0)
+		pixel = ivec2(-pixel.x, size.y - 1 - pixel.y);
+	else if (pixel.x >= size.x)
+		pixel = ivec2(2 * (size.x - 1) - pixel.x, size.y - 1 - pixel.y);
+
+	if (pixel.y < 0)
+		pixel = ivec2(size.x - 1 - pixel.x, -pixel.y);
+	else if (pixel.y >= size.y)
+		pixel = ivec2(size.x - 1 - pixel.x, 2 * (size.y - 1) - pixel.y);
+
+	return texelFetch(gimPositions, pixel, 0).xyz;
+}
+
+void main()
+{
+	ivec2 size = textureSize(gimPositions, 0);
+	ivec2 pixel = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);
+	vec4 vertexPosition = vec4(fetchPosition(pixel, size), 1.0);
+
+	// Normal is estimated with central differences, keeping the same orientation of the CPU triangulation
+	vec3 dx = fetchPosition(pixel + ivec2(1, 0), size) - fetchPosition(pixel - ivec2(1, 0), size);
+	vec3 dy = fetchPosition(pixel + ivec2(0, 1), size) - fetchPosition(pixel - ivec2(0, 1), size);
+	vec3 vertexNormal = cross(dx, dy);
+
+	vec3 normal3D = mat3(inverse(transpose(modelMatrix))) * vertexNormal;
+	fragmentNormal = vec4(normal3D, 0.0);
+	fragmentTextureCoords = vec2(pixel) / vec2(size - ivec2(1, 1));
+	fragmentPosition = modelMatrix * vertexPosition;
+	gl_Position = projectionMatrix * viewMatrix * modelMatrix * vertexPosition;
+}
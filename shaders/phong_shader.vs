@@ -11,10 +11,24 @@ out vec2 fragmentTextureCoords;
 uniform mat4 modelMatrix;
 uniform mat4 viewMatrix;
 uniform mat4 projectionMatrix;
+// When set, vertexNormal.xy holds an octahedral-encoded normal (VERTEX_LAYOUT_COMPACT)
+uniform bool octahedralNormals;
+
+vec3 decodeOctahedralNormal(vec2 encodedNormal)
+{
+	vec3 normal = vec3(encodedNormal, 1.0 - abs(encodedNormal.x) - abs(encodedNormal.y));
+	if (normal.z < 0.0)
+	{
+		vec2 signs = vec2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+		normal.xy = (1.0 - abs(normal.yx)) * signs;
+	}
+	return normalize(normal);
+}
 
 void main()
 {
-	vec3 normal3D = mat3(inverse(transpose(modelMatrix))) * vertexNormal.xyz;
+	vec3 normal = octahedralNormals ? decodeOctahedralNormal(vertexNormal.xy) : vertexNormal.xyz;
+	vec3 normal3D = mat3(inverse(transpose(modelMatrix))) * normal;
 	fragmentNormal = vec4(normal3D, 0.0);
 	fragmentTextureCoords = vertexTextureCoords;
 	fragmentPosition = modelMatrix * vertexPosition;
@@ -0,0 +1,94 @@
+#include "arena.h"
+#include <stdlib.h>
+
+static size_t alignSize(size_t size)
+{
+	return (size + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+}
+
+// The block header and its data share a single allocation. Data starts at the first aligned address after the header
+static ArenaBlock* createBlock(size_t capacity, ArenaBlock* previous)
+{
+	void* memory;
+	size_t headerSize = alignSize(sizeof(ArenaBlock));
+
+	if (posix_memalign(&memory, ARENA_ALIGNMENT, headerSize + capacity))
+		return 0;
+
+	ArenaBlock* block = memory;
+	block->previous = previous;
+	block->capacity = capacity;
+	block->used = 0;
+	block->data = (u8*)memory + headerSize;
+	return block;
+}
+
+static void freeBlocks(ArenaBlock* block)
+{
+	while (block)
+	{
+		ArenaBlock* previous = block->previous;
+		free(block);
+		block = previous;
+	}
+}
+
+// Returns 'size' bytes aligned to ARENA_ALIGNMENT. They are valid until the next arenaReset, arenaReserve or arenaRelease
+extern void* arenaAlloc(Arena* arena, size_t size)
+{
+	size = alignSize(size);
+
+	if (!arena->block || arena->block->used + size > arena->block->capacity)
+	{
+		size_t capacity = arena->block ? 2 * arena->block->capacity : ARENA_MINIMUM_BLOCK_SIZE;
+		if (capacity < size)
+			capacity = size;
+
+		ArenaBlock* block = createBlock(capacity, arena->block);
+		if (!block)
+			return 0;
+		arena->block = block;
+	}
+
+	void* memory = arena->block->data + arena->block->used;
+	arena->block->used += size;
+	return memory;
+}
+
+// Releases all allocations. If more than one block was needed, they are replaced by one block with their total capacity
+extern void arenaReset(Arena* arena)
+{
+	if (!arena->block)
+		return;
+
+	if (arena->block->previous)
+	{
+		size_t capacity = 0;
+		for (ArenaBlock* block = arena->block; block; block = block->previous)
+			capacity += block->capacity;
+
+		freeBlocks(arena->block);
+		arena->block = createBlock(capacity, 0);
+	}
+	else
+		arena->block->used = 0;
+}
+
+// Releases all allocations and makes sure that the next 'capacity' bytes can be allocated without touching the heap
+extern void arenaReserve(Arena* arena, size_t capacity)
+{
+	arenaReset(arena);
+
+	if (!arena->block || arena->block->capacity < capacity)
+	{
+		freeBlocks(arena->block);
+		arena->block = createBlock(capacity, 0);
+	}
+}
+
+// Releases all allocations and the memory of the arena
+extern void arenaRelease(Arena* arena)
+{
+	freeBlocks(arena->block);
+	arena->block = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef GIMMESH_ARENA_H
+#define GIMMESH_ARENA_H
+#include "common.h"
+#include <stddef.h>
+
+// Alignment, in bytes, of every allocation. It is enough for the rows of ImagePlanes
+#define ARENA_ALIGNMENT 32
+// Capacity of the first block when nothing was reserved
+#define ARENA_MINIMUM_BLOCK_SIZE (64 * 1024)
+
+typedef struct ArenaBlock ArenaBlock;
+typedef struct Arena Arena;
+
+struct ArenaBlock
+{
+	ArenaBlock* previous;
+	size_t capacity;
+	size_t used;
+	u8* data;
+};
+
+// Linear allocator. An allocation just moves forward the used space of the current block and all allocations are
+// released together by arenaReset. When the current block is full, a new block is chained to it. arenaReset merges
+// the chain into a single block, so once an arena has been used, the same sequence of allocations does not touch the heap.
+// A zero-initialized Arena is a valid empty arena
+struct Arena
+{
+	ArenaBlock* block;
+};
+
+extern void* arenaAlloc(Arena* arena, size_t size);
+extern void arenaReset(Arena* arena);
+extern void arenaReserve(Arena* arena, size_t capacity);
+extern void arenaRelease(Arena* arena);
+
+#endif
@@ -0,0 +1,291 @@
+#include "benchmark.h"
+#include "filter.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Each case is run this number of times and the fastest run is reported
+#define BENCHMARK_RUNS 3
+// Parameters of the multiscale cases, which are compared against the full resolution filter with the same parameters
+#define BENCHMARK_MULTISCALE_ITERATIONS 8
+#define BENCHMARK_MULTISCALE_SPATIAL_FACTOR 40.0f
+#define BENCHMARK_MULTISCALE_RANGE_FACTOR 0.3f
+#define BENCHMARK_MULTISCALE_MAX_LEVELS 3
+
+typedef struct
+{
+	const s8* name;
+	FilterMode filterMode;
+	s32 numIterations;
+	r32 spatialFactor;
+	r32 rangeFactor;
+	boolean blurNormals;
+	ImagePlanesPrecision precision;
+} BenchmarkCase;
+
+typedef struct
+{
+	FilterTimes times;
+	// Only for IMAGE_PLANES_FP16 cases, against the result of the case before them
+	r64 maxError;
+	r64 rmsError;
+} BenchmarkResult;
+
+typedef struct
+{
+	const s8* name;
+	FilterMode filterMode;
+	r32 spatialFactor;
+	r32 rangeFactor;
+	s32 numberOfAttributes;
+} BenchmarkAttributesCase;
+
+typedef struct
+{
+	r64 time;
+	r64 timeWithAttributes;
+	// Largest difference between an attribute channel and the filtered position channel it is a copy of
+	r64 maxAttributeError;
+	// Largest difference between the positions filtered with and without the attributes
+	r64 maxPositionError;
+} BenchmarkAttributesResult;
+
+// Each IMAGE_PLANES_FP16 case follows the IMAGE_PLANES_FP32 case with the same parameters, which is its reference
+static const BenchmarkCase benchmarkCases[] = {
+	{"recursive", RECURSIVE_FILTER, 3, 0.9f, 1.0f, false, IMAGE_PLANES_FP32},
+	{"recursive fp16", RECURSIVE_FILTER, 3, 0.9f, 1.0f, false, IMAGE_PLANES_FP16},
+	{"curvature", CURVATURE_FILTER, 3, 0.99f, 2.0f, false, IMAGE_PLANES_FP32},
+	{"curvature fp16", CURVATURE_FILTER, 3, 0.99f, 2.0f, false, IMAGE_PLANES_FP16},
+	{"curvature+blur", CURVATURE_FILTER, 3, 0.99f, 2.0f, true, IMAGE_PLANES_FP32},
+	{"curvature+blur fp16", CURVATURE_FILTER, 3, 0.99f, 2.0f, true, IMAGE_PLANES_FP16},
+	{"normalized convolution", NORMALIZED_CONVOLUTION_FILTER, 3, 0.99f, 2.0f, false, IMAGE_PLANES_FP32},
+	{"normalized convolution fp16", NORMALIZED_CONVOLUTION_FILTER, 3, 0.99f, 2.0f, false, IMAGE_PLANES_FP16},
+};
+
+// The attributes are copies of the positions, so they must come back identical to the filtered positions. 1 attribute
+// runs the 4 channel kernels and the others the kernels for any number of channels
+static const BenchmarkAttributesCase benchmarkAttributesCases[] = {
+	{"recursive +1", RECURSIVE_FILTER, 0.9f, 1.0f, 1},
+	{"recursive +3", RECURSIVE_FILTER, 0.9f, 1.0f, 3},
+	{"curvature +1", CURVATURE_FILTER, 0.99f, 2.0f, 1},
+	{"curvature +3", CURVATURE_FILTER, 0.99f, 2.0f, 3},
+	{"curvature +13", CURVATURE_FILTER, 0.99f, 2.0f, FILTER_MAX_ATTRIBUTES},
+	{"normalized convolution +1", NORMALIZED_CONVOLUTION_FILTER, 0.99f, 2.0f, 1},
+	{"normalized convolution +5", NORMALIZED_CONVOLUTION_FILTER, 0.99f, 2.0f, 5},
+};
+
+// Largest and root mean square distance between the vertices of two images
+static void measureError(const FloatImageData* reference, const FloatImageData* img, BenchmarkResult* result)
+{
+	r64 squaredDistances = 0.0;
+	result->maxError = 0.0;
+	for (s32 i = 0; i < img->width * img->height; ++i)
+	{
+		r64 squaredDistance = 0.0;
+		for (s32 c = 0; c < 3; ++c)
+		{
+			r64 difference = img->data[i * img->channels + c] - reference->data[i * reference->channels + c];
+			squaredDistance += difference * difference;
+		}
+		squaredDistances += squaredDistance;
+		if (sqrt(squaredDistance) > result->maxError)
+			result->maxError = sqrt(squaredDistance);
+	}
+	result->rmsError = sqrt(squaredDistances / (img->width * img->height));
+}
+
+static r64 getElapsedTime()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Filters the geometry image with filterGeometryImageFilterMultiscale, or with filterGeometryImageFilter when numLevels is 0,
+// and returns the time of the fastest run. The result of the last run is written to filteredGim
+static r64 runMultiscaleCase(const GeometryImage* gim, s32 numLevels, GeometryImage* filteredGim)
+{
+	BlurNormalsInformation blurNormalsInformation = {true, filterGetNormalsBlurSS(BENCHMARK_MULTISCALE_RANGE_FACTOR)};
+	r64 fastest = 0.0;
+
+	for (s32 run = 0; run < BENCHMARK_RUNS; ++run)
+	{
+		gimFreeGeometryImage(filteredGim);
+		r64 t = getElapsedTime();
+		if (numLevels > 0)
+			*filteredGim = filterGeometryImageFilterMultiscale(gim, BENCHMARK_MULTISCALE_ITERATIONS,
+				BENCHMARK_MULTISCALE_SPATIAL_FACTOR, BENCHMARK_MULTISCALE_RANGE_FACTOR, CURVATURE_FILTER, &blurNormalsInformation,
+				numLevels, false);
+		else
+			*filteredGim = filterGeometryImageFilter(gim, BENCHMARK_MULTISCALE_ITERATIONS, BENCHMARK_MULTISCALE_SPATIAL_FACTOR,
+				BENCHMARK_MULTISCALE_RANGE_FACTOR, CURVATURE_FILTER, &blurNormalsInformation, false);
+		t = getElapsedTime() - t;
+		if (run == 0 || t < fastest)
+			fastest = t;
+	}
+
+	return fastest;
+}
+
+// Filters the geometry image with and without copies of its positions as attributes, see benchmarkAttributesCases
+static BenchmarkAttributesResult runAttributesCase(FilterContext* context, const GeometryImage* gim,
+	const BenchmarkAttributesCase* attributesCase)
+{
+	BenchmarkAttributesResult result = {0};
+	const FloatImageData* img = &gim->img;
+	s32 numberOfPixels = img->width * img->height;
+
+	GeometryImage filteredGim = {0};
+	filteredGim.img = graphicsFloatImageCopy(img);
+	filterGeometryImageFilterWithContext(context, gim, &filteredGim, 3, attributesCase->spatialFactor,
+		attributesCase->rangeFactor, attributesCase->filterMode, 0, false);
+	result.time = filterGetLastTimes().total;
+
+	FloatImageData attributes;
+	attributes.width = img->width;
+	attributes.height = img->height;
+	attributes.channels = attributesCase->numberOfAttributes;
+	attributes.data = malloc(sizeof(r32) * numberOfPixels * attributes.channels);
+	for (s32 i = 0; i < numberOfPixels; ++i)
+		for (s32 c = 0; c < attributes.channels; ++c)
+			attributes.data[i * attributes.channels + c] = img->data[i * img->channels + c % 3];
+
+	GeometryImage filteredWithAttributesGim = {0};
+	filteredWithAttributesGim.img = graphicsFloatImageCopy(img);
+	filterGeometryImageFilterWithAttributes(context, gim, &filteredWithAttributesGim, &attributes, 3,
+		attributesCase->spatialFactor, attributesCase->rangeFactor, attributesCase->filterMode, 0, false);
+	result.timeWithAttributes = filterGetLastTimes().total;
+
+	for (s32 i = 0; i < numberOfPixels; ++i)
+	{
+		const r32* position = &filteredWithAttributesGim.img.data[i * img->channels];
+		for (s32 c = 0; c < attributes.channels; ++c)
+			result.maxAttributeError = fmax(result.maxAttributeError,
+				fabs(attributes.data[i * attributes.channels + c] - position[c % 3]));
+		for (s32 c = 0; c < 3; ++c)
+			result.maxPositionError = fmax(result.maxPositionError, fabs(position[c] - filteredGim.img.data[i * img->channels + c]));
+	}
+
+	graphicsFloatImageFree(&attributes);
+	gimFreeGeometryImage(&filteredWithAttributesGim);
+	gimFreeGeometryImage(&filteredGim);
+	return result;
+}
+
+// Filters the geometry image with a fixed set of parameters and prints the time spent in each stage of the filter
+extern int benchmarkRun(const s8* gimPath)
+{
+	GeometryImage gim = {0};
+	if (gimParseGeometryImageFile(&gim, (const u8*)gimPath))
+		return -1;
+	gimEstimateNormals(&gim);
+
+	s32 numberOfCases = sizeof(benchmarkCases) / sizeof(BenchmarkCase);
+	BenchmarkResult* results = calloc(numberOfCases, sizeof(BenchmarkResult));
+
+	// The result is reused by all runs and each case has its own plan, so only the filter itself is measured
+	GeometryImage filteredGim = {0};
+	filteredGim.img = graphicsFloatImageCopy(&gim.img);
+	FloatImageData referenceImg = graphicsFloatImageCopy(&gim.img);
+
+	for (s32 i = 0; i < numberOfCases; ++i)
+	{
+		const BenchmarkCase* benchmarkCase = &benchmarkCases[i];
+		FilterPlanOptions options = {benchmarkCase->numIterations, benchmarkCase->filterMode, benchmarkCase->blurNormals,
+			benchmarkCase->precision};
+		FilterParameters parameters = {benchmarkCase->spatialFactor, benchmarkCase->rangeFactor, 0.9f};
+		FilterPlan plan = filterPlanCreate(gim.img.width, gim.img.height, &options);
+
+		for (s32 run = 0; run < BENCHMARK_RUNS; ++run)
+		{
+			filterExecute(&plan, &gim, &filteredGim, &parameters);
+			FilterTimes times = filterGetLastTimes();
+			if (run == 0 || times.total < results[i].times.total)
+				results[i].times = times;
+		}
+
+		if (benchmarkCase->precision == IMAGE_PLANES_FP16)
+			measureError(&referenceImg, &filteredGim.img, &results[i]);
+		else
+			memcpy(referenceImg.data, filteredGim.img.data, sizeof(r32) * gim.img.width * gim.img.height * gim.img.channels);
+
+		filterPlanDestroy(&plan);
+	}
+
+	s32 numberOfAttributesCases = sizeof(benchmarkAttributesCases) / sizeof(BenchmarkAttributesCase);
+	BenchmarkAttributesResult* attributesResults = calloc(numberOfAttributesCases, sizeof(BenchmarkAttributesResult));
+	FilterContext context = {0};
+	for (s32 i = 0; i < numberOfAttributesCases; ++i)
+		attributesResults[i] = runAttributesCase(&context, &gim, &benchmarkAttributesCases[i]);
+	filterContextDestroy(&context);
+
+	// Multiscale cases. The first one is the full resolution filter, which is their reference
+	r64 multiscaleTimes[BENCHMARK_MULTISCALE_MAX_LEVELS + 1];
+	BenchmarkResult multiscaleResults[BENCHMARK_MULTISCALE_MAX_LEVELS + 1] = {0};
+	GeometryImage fullResolutionGim = {0};
+	multiscaleTimes[0] = runMultiscaleCase(&gim, 0, &fullResolutionGim);
+	for (s32 l = 1; l <= BENCHMARK_MULTISCALE_MAX_LEVELS; ++l)
+	{
+		GeometryImage multiscaleGim = {0};
+		multiscaleTimes[l] = runMultiscaleCase(&gim, l, &multiscaleGim);
+		measureError(&fullResolutionGim.img, &multiscaleGim.img, &multiscaleResults[l]);
+		gimFreeGeometryImage(&multiscaleGim);
+	}
+	// The displacement of the full resolution filter, which the errors are compared to
+	measureError(&gim.img, &fullResolutionGim.img, &multiscaleResults[0]);
+	gimFreeGeometryImage(&fullResolutionGim);
+
+	printf("\nBenchmark: %s (%dx%d), fastest of %d runs, times in seconds\n", gimPath, gim.img.width, gim.img.height, BENCHMARK_RUNS);
+	printf("%-28s %10s %10s %10s %10s %10s %10s\n", "case", "dt", "h", "c", "v", "pi", "total");
+	for (s32 i = 0; i < numberOfCases; ++i)
+	{
+		const FilterTimes* times = &results[i].times;
+		printf("%-28s %10.4f %10.4f %10.4f %10.4f %10.4f %10.4f\n", benchmarkCases[i].name, times->domainTransforms,
+			times->horizontalStep, times->cStep, times->verticalStep, times->piStep, times->total);
+	}
+
+	printf("\nError of the fp16 cases against their fp32 case (distance between vertices)\n");
+	printf("%-28s %14s %14s\n", "case", "max", "rms");
+	for (s32 i = 0; i < numberOfCases; ++i)
+		if (benchmarkCases[i].precision == IMAGE_PLANES_FP16)
+			printf("%-28s %14.6g %14.6g\n", benchmarkCases[i].name, results[i].maxError, results[i].rmsError);
+
+	printf("\nPositions filtered with copies of themselves as attributes (time without and with the attributes, largest\n");
+	printf("difference between the attributes and the positions, and between the positions with and without the attributes)\n");
+	printf("%-28s %10s %10s %14s %14s\n", "case", "total", "attributes", "attribute", "position");
+	for (s32 i = 0; i < numberOfAttributesCases; ++i)
+		printf("%-28s %10.4f %10.4f %14.6g %14.6g\n", benchmarkAttributesCases[i].name, attributesResults[i].time,
+			attributesResults[i].timeWithAttributes, attributesResults[i].maxAttributeError, attributesResults[i].maxPositionError);
+
+	printf("\nMultiscale filter with ss = %.1f, sr = %.1f and %d iterations against the full resolution filter\n",
+		BENCHMARK_MULTISCALE_SPATIAL_FACTOR, BENCHMARK_MULTISCALE_RANGE_FACTOR, BENCHMARK_MULTISCALE_ITERATIONS);
+	printf("(the full resolution row shows how much the filter moves the vertices)\n");
+	printf("%-28s %10s %10s %14s %14s\n", "case", "total", "speedup", "max", "rms");
+	for (s32 l = 0; l <= BENCHMARK_MULTISCALE_MAX_LEVELS; ++l)
+	{
+		s8 name[32];
+		if (l > 0)
+			sprintf(name, "multiscale %d level%s", l, (l > 1) ? "s" : "");
+		else
+			strcpy(name, "full resolution");
+		printf("%-28s %10.4f %10.2f %14.6g %14.6g\n", name, multiscaleTimes[l], multiscaleTimes[0] / multiscaleTimes[l],
+			multiscaleResults[l].maxError, multiscaleResults[l].rmsError);
+	}
+
+	// Attributes run through the same kernels as the positions they are copies of, so any difference is a bug
+	s32 result = 0;
+	for (s32 i = 0; i < numberOfAttributesCases; ++i)
+		if (attributesResults[i].maxAttributeError > 0.0)
+		{
+			fprintf(stderr, "Error: the attributes of case '%s' differ from the positions\n", benchmarkAttributesCases[i].name);
+			result = -1;
+		}
+
+	free(results);
+	free(attributesResults);
+	graphicsFloatImageFree(&referenceImg);
+	gimFreeGeometryImage(&filteredGim);
+	gimFreeGeometryImage(&gim);
+	return result;
+}
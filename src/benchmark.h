@@ -0,0 +1,7 @@
+#ifndef GIMMESH_BENCHMARK_H
+#define GIMMESH_BENCHMARK_H
+#include "common.h"
+
+extern int benchmarkRun(const s8* gimPath);
+
+#endif
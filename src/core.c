@@ -4,50 +4,225 @@
 #include "domain_transform.h"
 #include "menu.h"
 #include "parametrization.h"
+#include "pick.h"
+#include "image_export.h"
 #include <math.h>
 #include "obj.h"
 #include <stdio.h>
 
 #define PHONG_VERTEX_SHADER_PATH "./shaders/phong_shader.vs"
 #define PHONG_FRAGMENT_SHADER_PATH "./shaders/phong_shader.fs"
+#define GIM_PHONG_VERTEX_SHADER_PATH "./shaders/gim_phong_shader.vs"
 #define GIM_ENTITY_COLOR (Vec4) {1.0f, 1.0f, 1.0f, 1.0f}
 
+// Tells if the filtered geometry image should be rendered by uploading only its positions and generating
+// the vertices in the vertex shader, instead of building and uploading a full mesh in the CPU
+#define RENDER_GIM_ON_GPU
+// Coarser levels of the geometry image pyramid stop before getting smaller than this size
+#define GIM_LOD_MINIMUM_SIZE 33
+// Number of geometry image samples wanted across each pixel of the projected diameter of the model
+#define GIM_LOD_SAMPLES_PER_PIXEL 1.0f
+
+typedef struct
+{
+	Mesh mesh;
+	s32 size;
+} GimLevelOfDetail;
+
+extern s32 windowHeight;
+
 static GeometryImage originalGim, noisyGim, filteredGim;
 static Entity gimEntity;
-static Shader phongShader;
+static GimLevelOfDetail* gimLevelsOfDetail; // Coarser levels only, the finest level is gimEntity's mesh
+static boolean gimLevelsOfDetailOutdated; // Set when only a region of filteredGim changed, see filterRegionCallback
+static Vec4 gimBoundingSphere; // Center in xyz and radius in w, in object space
+static PickPyramid gimPickPyramid; // Boxes over filteredGim, used to pick pixels with the mouse
+static FilterContext regionFilterContext; // Scratch memory reused by every region filter, see filterRegionCallback
+static Shader phongShader, gimPhongShader;
 static PerspectiveCamera camera;
 static Light* lights;
 
+static Vec4 computeBoundingSphere(const FloatImageData* img)
+{
+	s32 numberOfPixels = img->width * img->height;
+	Vec3 center = (Vec3) {0.0f, 0.0f, 0.0f};
+	r32 radius = 0.0f;
+
+	for (s32 i = 0; i < numberOfPixels; ++i)
+		center = gmAddVec3(center, *(Vec3*)&img->data[i * img->channels]);
+	center = gmScalarProductVec3(1.0f / numberOfPixels, center);
+
+	for (s32 i = 0; i < numberOfPixels; ++i)
+	{
+		r32 distance = gmLengthVec3(gmSubtractVec3(*(Vec3*)&img->data[i * img->channels], center));
+		if (distance > radius) radius = distance;
+	}
+
+	return (Vec4) {center.x, center.y, center.z, radius};
+}
+
+// Rebuilds the coarser levels of detail from the filtered geometry image.
+// The number and sizes of the levels only depend on the geometry image size, so existing meshes are reused
+static void updateLevelsOfDetail()
+{
+	FloatImageData* pyramid = gimCreatePyramid(&filteredGim.img, GIM_LOD_MINIMUM_SIZE);
+	u32 numberOfLevels = array_get_length(pyramid);
+
+	if (!gimLevelsOfDetail)
+		gimLevelsOfDetail = array_create(GimLevelOfDetail, numberOfLevels);
+
+	for (u32 i = 1; i < numberOfLevels; ++i)
+	{
+		boolean exists = i - 1 < array_get_length(gimLevelsOfDetail);
+#ifdef RENDER_GIM_ON_GPU
+		if (exists)
+		{
+			graphicsMeshUpdateGeometryImage(&gimLevelsOfDetail[i - 1].mesh, &pyramid[i]);
+			continue;
+		}
+		Mesh m = graphicsMeshCreateFromGeometryImageWithColor(&pyramid[i], GIM_ENTITY_COLOR);
+#else
+		GeometryImage levelGim = {0};
+		levelGim.img = graphicsFloatImageCopy(&pyramid[i]);
+		gimGeometryImageUpdate3D(&levelGim);
+		Mesh m = gimGeometryImageToMesh(&levelGim, GIM_ENTITY_COLOR);
+		gimFreeGeometryImage(&levelGim);
+		if (exists)
+		{
+			graphicsMeshDelete(&gimLevelsOfDetail[i - 1].mesh, false, false);
+			gimLevelsOfDetail[i - 1].mesh = m;
+			continue;
+		}
+#endif
+		GimLevelOfDetail levelOfDetail = (GimLevelOfDetail) {m, pyramid[i].width};
+		array_push(gimLevelsOfDetail, &levelOfDetail);
+	}
+
+	gimFreePyramid(pyramid);
+	gimBoundingSphere = computeBoundingSphere(&filteredGim.img);
+	gimLevelsOfDetailOutdated = false;
+}
+
 static void updateFilteredGimMesh()
 {
+#ifdef RENDER_GIM_ON_GPU
+	graphicsMeshUpdateGeometryImage(&gimEntity.mesh, &filteredGim.img);
+#else
 	Mesh m = gimGeometryImageToMesh(&filteredGim, GIM_ENTITY_COLOR);
 	graphicsEntityMeshReplace(&gimEntity, m, false, false);
+#endif
+	updateLevelsOfDetail();
+	pickPyramidUpdate(&gimPickPyramid, &filteredGim.img);
 }
 
-static float getNormalsBlurSSFromSr(r32 sr)
+// Selects the coarsest level of detail that still has GIM_LOD_SAMPLES_PER_PIXEL samples for each pixel
+// of the projected diameter of the bounding sphere. 0 is the full resolution geometry image
+static s32 selectLevelOfDetail()
 {
-	// Tests:
-	// 10.0f = Excelent curvature preservation and very bad mesh preservation
-	// 30.0f = Good curvature preservation and bad mesh preservation
-	// 50.0f = Regular curvature preservation and regular mesh preservation
-	// 70.0f+ = Bad curvature preservation and good mesh preservation
-	r32 variance = 30.0f * sr;
-	return expf(-sqrtf(2.0f) / variance);
+	Vec4 center = gmMultiplyMat4AndVec4(&gimEntity.modelMatrix,
+		(Vec4) {gimBoundingSphere.x, gimBoundingSphere.y, gimBoundingSphere.z, 1.0f});
+	r32 scale = fmaxf(gimEntity.worldScale.x, fmaxf(gimEntity.worldScale.y, gimEntity.worldScale.z));
+	r32 radius = gimBoundingSphere.w * scale;
+	r32 distance = gmLengthVec4(gmSubtractVec4(center, camera.position));
+
+	if (distance <= radius)
+		return 0;
+
+	// projectionMatrix[1][1] is the ratio between the near plane distance and its half height
+	r32 projectedDiameter = windowHeight * radius * fabsf(camera.projectionMatrix.data[1][1]) / distance;
+	r32 requiredSize = projectedDiameter * GIM_LOD_SAMPLES_PER_PIXEL;
+
+	s32 level = 0;
+	for (u32 i = 0; i < array_get_length(gimLevelsOfDetail); ++i)
+	{
+		if (gimLevelsOfDetail[i].size < requiredSize)
+			break;
+		level = i + 1;
+	}
+	return level;
 }
 
-static void filterCurvatureCallback(r32 ss, r32 sr, s32 n)
+// The filtered geometry image 3D information is only built when it is really needed (e.g. when exporting)
+static void updateFilteredGim3D()
+{
+	if (!filteredGim.vertices)
+		gimGeometryImageUpdate3D(&filteredGim);
+}
+
+// Must be called when filteredGim's image changes without replacing filteredGim
+static void invalidateFilteredGim3D()
+{
+	if (filteredGim.vertices)
+		array_release(filteredGim.vertices);
+	if (filteredGim.indexes)
+		array_release(filteredGim.indexes);
+	if (filteredGim.normals)
+		free(filteredGim.normals);
+	filteredGim.vertices = 0;
+	filteredGim.indexes = 0;
+	filteredGim.normals = 0;
+}
+
+// When pyramidLevels is greater than 0, the geometry image is filtered in multiple scales, which is faster for large spatial factors
+// Otherwise, when convergenceTolerance is greater than 0, n is the maximum number of iterations of an adaptive filter
+static void filterCurvatureCallback(r32 ss, r32 sr, s32 n, r32 convergenceTolerance, s32 pyramidLevels)
 {
 	// Fill blur information
 	BlurNormalsInformation blurNormalsInformation = {0};
 	blurNormalsInformation.shouldBlur = true;
-	blurNormalsInformation.blurSS = getNormalsBlurSSFromSr(sr);
+	blurNormalsInformation.blurSS = filterGetNormalsBlurSS(sr);
 
 	gimFreeGeometryImage(&filteredGim);
-	filteredGim = filterGeometryImageFilter(&noisyGim, n, ss, sr, CURVATURE_FILTER, &blurNormalsInformation, true);
-	gimGeometryImageUpdate3D(&filteredGim);
+	if (pyramidLevels > 0)
+		filteredGim = filterGeometryImageFilterMultiscale(&noisyGim, n, ss, sr, CURVATURE_FILTER, &blurNormalsInformation, pyramidLevels, true);
+	else if (convergenceTolerance > 0.0f)
+		filteredGim = filterGeometryImageFilterAdaptive(&noisyGim, n, convergenceTolerance, ss, sr, CURVATURE_FILTER,
+			&blurNormalsInformation, true);
+	else
+		filteredGim = filterGeometryImageFilter(&noisyGim, n, ss, sr, CURVATURE_FILTER, &blurNormalsInformation, true);
+#ifndef RENDER_GIM_ON_GPU
+	updateFilteredGim3D();
+#endif
 	updateFilteredGimMesh();
 }
 
+// Refilters only the region <x, y, width, height> of the noisy geometry image, keeping the rest of the filtered geometry image
+static void filterRegionCallback(r32 ss, r32 sr, s32 n, s32 x, s32 y, s32 width, s32 height)
+{
+	// Fill blur information
+	BlurNormalsInformation blurNormalsInformation = {0};
+	blurNormalsInformation.shouldBlur = true;
+	blurNormalsInformation.blurSS = filterGetNormalsBlurSS(sr);
+
+	FilterRegion region = (FilterRegion) {x, y, width, height};
+	FilterRegion* dirtyRegions = filterGeometryImageFilterRegion(&regionFilterContext, &noisyGim, &filteredGim, n, ss, sr,
+		CURVATURE_FILTER, &blurNormalsInformation, region, true);
+	invalidateFilteredGim3D();
+
+	// Only the boxes of the pick pyramid over the changed regions are recalculated
+	for (u32 i = 0; i < array_get_length(dirtyRegions); ++i)
+		pickPyramidUpdateRegion(&gimPickPyramid, &filteredGim.img,
+			dirtyRegions[i].x, dirtyRegions[i].y, dirtyRegions[i].width, dirtyRegions[i].height);
+
+#ifdef RENDER_GIM_ON_GPU
+	// Only the changed part of the positions texture is uploaded
+	for (u32 i = 0; i < array_get_length(dirtyRegions); ++i)
+		graphicsMeshUpdateGeometryImageRegion(&gimEntity.mesh, &filteredGim.img,
+			dirtyRegions[i].x, dirtyRegions[i].y, dirtyRegions[i].width, dirtyRegions[i].height);
+	// Rebuilding the coarser levels costs as much as the whole image, so it waits until one of them is rendered. Until then
+	// the level is selected with the previous bounding sphere, which a local change barely moves
+	gimLevelsOfDetailOutdated = true;
+#else
+	// The mesh is rebuilt as in updateFilteredGimMesh, but the pick pyramid is already up to date
+	updateFilteredGim3D();
+	Mesh m = gimGeometryImageToMesh(&filteredGim, GIM_ENTITY_COLOR);
+	graphicsEntityMeshReplace(&gimEntity, m, false, false);
+	updateLevelsOfDetail();
+#endif
+
+	array_release(dirtyRegions);
+}
+
 static void textureChangeSolidCallback()
 {
 	graphicsMeshChangeColor(&gimEntity.mesh, GIM_ENTITY_COLOR, false);
@@ -58,28 +233,26 @@ static void textureChangeCurvatureCallback(r32 curvatureSpatialFactor, r32 curva
 	// Fill blur information
 	BlurNormalsInformation blurNormalsInformation = {0};
 	blurNormalsInformation.shouldBlur = true;
-	blurNormalsInformation.blurSS = getNormalsBlurSSFromSr(curvatureRangeFactor);
+	blurNormalsInformation.blurSS = filterGetNormalsBlurSS(curvatureRangeFactor);
 
 	FloatImageData curvatureImage = dtGenerateDomainTransformsImage(&noisyGim, curvatureSpatialFactor, curvatureRangeFactor, &blurNormalsInformation);
-	FloatImageData normalizedCurvatureImage = gimNormalizeImageForVisualization(&curvatureImage);
-	graphicsFloatImageSave("./res/curvatures.bmp", &normalizedCurvatureImage);
+	ImageData normalizedCurvatureImage = gimNormalizeImageForVisualization(&curvatureImage);
+	imageExportDebugImage("./res/curvatures", &normalizedCurvatureImage, &curvatureImage);
 	graphicsFloatImageFree(&curvatureImage);
-	s32 currentTexture = graphicsTextureCreateFromFloatData(&normalizedCurvatureImage);
-	//gimCheckGeometryImage(&normalizedCurvatureImage);
-	graphicsFloatImageFree(&normalizedCurvatureImage);
+	s32 currentTexture = graphicsTextureCreateFromData(&normalizedCurvatureImage);
+	graphicsImageFree(&normalizedCurvatureImage);
 	if (currentTexture != -1) graphicsMeshChangeDiffuseMap(&gimEntity.mesh, currentTexture, true);
 }
 
 static void textureChangeNormalsCallback(r32 curvatureRangeFactor)
 {
-	r32 normalsBlurSpatialFactor = getNormalsBlurSSFromSr(curvatureRangeFactor);
+	r32 normalsBlurSpatialFactor = filterGetNormalsBlurSS(curvatureRangeFactor);
 	FloatImageData curvatureImage = dtGenerateNormalImage(&noisyGim, true, normalsBlurSpatialFactor);
-	FloatImageData normalizedCurvatureImage = gimNormalizeImageForVisualization(&curvatureImage);
-	graphicsFloatImageSave("./res/normals.bmp", &normalizedCurvatureImage);
+	ImageData normalizedCurvatureImage = gimNormalizeImageForVisualization(&curvatureImage);
+	imageExportDebugImage("./res/normals", &normalizedCurvatureImage, &curvatureImage);
 	graphicsFloatImageFree(&curvatureImage);
-	s32 currentTexture = graphicsTextureCreateFromFloatData(&normalizedCurvatureImage);
-	//gimCheckGeometryImage(&normalizedCurvatureImage);
-	graphicsFloatImageFree(&normalizedCurvatureImage);
+	s32 currentTexture = graphicsTextureCreateFromData(&normalizedCurvatureImage);
+	graphicsImageFree(&normalizedCurvatureImage);
 	if (currentTexture != -1) graphicsMeshChangeDiffuseMap(&gimEntity.mesh, currentTexture, true);
 }
 
@@ -90,25 +263,32 @@ static void textureChangeCustomCallback(char* customTexturePath)
 	if (currentTexture != -1) graphicsMeshChangeDiffuseMap(&gimEntity.mesh, currentTexture, true);
 }
 
-static void noiseGeneratorCallback(r32 intensity)
+static void noiseGeneratorCallback(r32 intensity, s32 seed)
 {
 	gimFreeGeometryImage(&noisyGim);
 	gimFreeGeometryImage(&filteredGim);
-	noisyGim = gimAddNoise(&originalGim, intensity);
+	noisyGim = gimAddNoise(&originalGim, intensity, (u64)seed);
 	//gimCheckGeometryImage(&noisyGim.img);
+	// Only the normals are needed, by the domain transforms, unless the mesh is built in the CPU
+#ifdef RENDER_GIM_ON_GPU
+	gimEstimateNormals(&noisyGim);
+#else
 	gimGeometryImageUpdate3D(&noisyGim);
+#endif
 	filteredGim = gimCopyGeometryImage(&noisyGim, true);
 	updateFilteredGimMesh();
 }
 
 static void exportWavefrontCallback()
 {
+	updateFilteredGim3D();
 	gimExportToObjFile(&filteredGim, "./output.obj");
 	printf("Created ./output.obj\n");
 }
 
 static void exportPointCloudCallback()
 {
+	updateFilteredGim3D();
 	gimExportToPointCloudFile(&filteredGim, "./point_cloud.txt");
 	printf("Created ./point_cloud.txt\n");
 }
@@ -119,6 +299,11 @@ static void exportGimCallback()
 	printf("Created ./output.gim\n");
 }
 
+static void debugImageFormatCallback(s32 format)
+{
+	imageExportSetFormat((ImageExportFormat)format);
+}
+
 static void registerMenuCallbacks()
 {
 	menuRegisterFilterCallBack(filterCurvatureCallback);
@@ -130,6 +315,8 @@ static void registerMenuCallbacks()
 	menuRegisterExportWavefrontCallBack(exportWavefrontCallback);
 	menuRegisterExportPointCloudCallBack(exportPointCloudCallback);
 	menuRegisterExportGimCallBack(exportGimCallback);
+	menuRegisterFilterRegionCallBack(filterRegionCallback);
+	menuRegisterDebugImageFormatCallBack(debugImageFormatCallback);
 }
 
 static PerspectiveCamera createCamera()
@@ -184,48 +371,77 @@ static Light* createLights()
 	return lights;
 }
 
-static int loadGeometryImage(const s8* gimPath)
+static int loadGeometryImage(const s8* gimPath, boolean checkBorderSymmetry)
 {
 	// Parse the original geometry image
 	if (gimParseGeometryImageFile(&originalGim, gimPath))
 		return -1;
 	// Check the border symmetry of the parsed GIM
-	gimCheckGeometryImage(&originalGim.img);
-	// Update 3d information
+	if (checkBorderSymmetry)
+	{
+		GimBorderCheckResult borderCheck = gimCheckGeometryImage(&originalGim.img, 0.0f);
+		if (borderCheck.numberOfMismatches > 0)
+			printf("Warning: %d of %d border pixels do not match their mirror (first: <%d, %d> and <%d, %d>, max distance: %g)\n",
+				borderCheck.numberOfMismatches, borderCheck.numberOfCheckedPairs, borderCheck.firstMismatch.x, borderCheck.firstMismatch.y,
+				borderCheck.firstMismatchMirror.x, borderCheck.firstMismatchMirror.y, borderCheck.maximumDistance);
+	}
+	// Update 3d information. Only the normals are needed, by the domain transforms, unless the mesh is built in the CPU
+#ifdef RENDER_GIM_ON_GPU
+	gimEstimateNormals(&originalGim);
+#else
 	gimGeometryImageUpdate3D(&originalGim);
+#endif
 	// Copy original gim to noisy gim
 	noisyGim = gimCopyGeometryImage(&originalGim, true);
 	// Copy original gim to filtered gim
 	filteredGim = gimCopyGeometryImage(&originalGim, true);
 
 	// Transform filtered geometry image to a mesh
+#ifdef RENDER_GIM_ON_GPU
+	Mesh m = graphicsMeshCreateFromGeometryImageWithColor(&filteredGim.img, GIM_ENTITY_COLOR);
+#else
 	Mesh m = gimGeometryImageToMesh(&filteredGim, GIM_ENTITY_COLOR);
+#endif
 	// Create filteredGim's entity
 	graphicsEntityCreate(&gimEntity, m, (Vec4){0.0f, 0.0f, 0.0f, 1.0f}, (Vec3){0.0f, 0.0f, 0.0f}, (Vec3){1.0f, 1.0f, 1.0f});
+	// Create the coarser levels used when the model is far from the camera
+	updateLevelsOfDetail();
+	// Create the boxes used to pick the geometry image with the mouse
+	pickPyramidUpdate(&gimPickPyramid, &filteredGim.img);
 	return 0;
 }
 
-extern int coreInit(const s8* gimPath)
+extern int coreInit(const s8* gimPath, boolean checkBorderSymmetry)
 {
 	// Register menu callbacks
 	registerMenuCallbacks();
 	// Create shader
 	phongShader = graphicsShaderCreate(PHONG_VERTEX_SHADER_PATH, PHONG_FRAGMENT_SHADER_PATH);
+	gimPhongShader = graphicsShaderCreate(GIM_PHONG_VERTEX_SHADER_PATH, PHONG_FRAGMENT_SHADER_PATH);
 	// Create camera
 	camera = createCamera();
 	// Create light
 	lights = createLights();
 	// Load geometry image	
-	if (loadGeometryImage(gimPath))
+	if (loadGeometryImage(gimPath, checkBorderSymmetry))
 		return -1;
 	return 0;
 }
 
 extern void coreDestroy()
 {
+	imageExportFlush();
 	gimFreeGeometryImage(&originalGim);
 	gimFreeGeometryImage(&noisyGim);
 	gimFreeGeometryImage(&filteredGim);
+	pickPyramidDestroy(&gimPickPyramid);
+	filterContextDestroy(&regionFilterContext);
+	if (gimLevelsOfDetail)
+	{
+		for (u32 i = 0; i < array_get_length(gimLevelsOfDetail); ++i)
+			graphicsMeshDelete(&gimLevelsOfDetail[i].mesh, false, false);
+		array_release(gimLevelsOfDetail);
+	}
 	array_release(lights);
 }
 
@@ -236,7 +452,22 @@ extern void coreUpdate(r32 deltaTime)
 
 extern void coreRender()
 {
-	graphicsEntityRenderPhongShader(phongShader, &camera, &gimEntity, lights);
+	Entity renderedEntity = gimEntity;
+	s32 level = selectLevelOfDetail();
+	if (level > 0)
+	{
+		if (gimLevelsOfDetailOutdated)
+			updateLevelsOfDetail();
+		// Only the geometry changes, the current texture of the entity is kept
+		renderedEntity.mesh = gimLevelsOfDetail[level - 1].mesh;
+		renderedEntity.mesh.diffuseInfo = gimEntity.mesh.diffuseInfo;
+	}
+
+#ifdef RENDER_GIM_ON_GPU
+	graphicsEntityRenderPhongShader(gimPhongShader, &camera, &renderedEntity, lights);
+#else
+	graphicsEntityRenderPhongShader(phongShader, &camera, &renderedEntity, lights);
+#endif
 	//graphicsEntityRenderPhongShader(phongShader, &camera, &e, lights);
 }
 
@@ -344,9 +575,26 @@ extern void coreMouseChangeProcess(boolean reset, r64 xPos, r64 yPos)
 	yPosOld = yPos;
 }
 
+// Clicks only arrive while the menu is closed, when the cursor is disabled and the camera follows the mouse, so the
+// picking ray goes through the center of the screen
 extern void coreMouseClickProcess(s32 button, s32 action, r64 xPos, r64 yPos)
 {
-
+	if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS)
+		return;
+
+	// The ray is cast in object space, where the positions of the geometry image are
+	Mat4 inverseModelMatrix;
+	if (!gmInverseMat4(&gimEntity.modelMatrix, &inverseModelMatrix))
+		return;
+	Vec4 origin = gmMultiplyMat4AndVec4(&inverseModelMatrix, (Vec4) {camera.position.x, camera.position.y, camera.position.z, 1.0f});
+	Vec4 direction = gmMultiplyMat4AndVec4(&inverseModelMatrix, (Vec4) {camera.view.x, camera.view.y, camera.view.z, 0.0f});
+
+	PickResult pick;
+	if (!pickCastRay(&gimPickPyramid, &filteredGim.img, (Vec3) {origin.x, origin.y, origin.z},
+		(Vec3) {direction.x, direction.y, direction.z}, &pick))
+		return;
+
+	menuSetFilterRegionCenter(pick.pixel.x, pick.pixel.y);
 }
 
 extern void coreScrollChangeProcess(r64 xOffset, r64 yOffset)
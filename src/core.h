@@ -4,7 +4,7 @@
 #include "common.h"
 
 extern int coreParseArguments(s32 argc, char** argv);
-extern int coreInit(const s8* meshFilePath);
+extern int coreInit(const s8* meshFilePath, boolean checkBorderSymmetry);
 extern void coreDestroy();
 extern void coreUpdate(r32 deltaTime);
 extern void coreRender();
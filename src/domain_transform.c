@@ -1,49 +1,55 @@
 #include "domain_transform.h"
 #include "gim.h"
+#include "image_planes.h"
+#include "parallel.h"
 #include <assert.h>
+#include <string.h>
 
-static Vec4* blurNormals(const GeometryImage* gim, r32 ss)
-{
-	Vec4* blurredNormals = malloc(sizeof(Vec4) * gim->img.width * gim->img.height);
+// Rows of normals compared by each task of dtSequenceUpdate
+#define SEQUENCE_ROWS_PER_TASK 16
 
+// Copies the normals of the geometry image to planes allocated in 'arena', blurring them if requested
+static ImagePlanes createNormalPlanes(Arena* arena, const GeometryImage* gim, boolean shouldBlur, r32 blurSS)
+{
 	// filter properties currently being used to perform the blur
 	const s32 blurIterations = 3;
 
-	// To properly use the filter, we need to wrap the normals using a "fake geometry image"
-	GeometryImage normalsGim = {0};
-	normalsGim.img.channels = 4;
-	normalsGim.img.width = gim->img.width;
-	normalsGim.img.height = gim->img.height;
-	normalsGim.img.data = malloc(sizeof(Vec4) * gim->img.width * gim->img.height * 3);
-
-	// Fill the fake geometry image with the horizontal domain transforms
-	// We will fill all three channels with the domain transform value
-	for (s32 i = 0; i < normalsGim.img.height; ++i)
-		for (s32 j = 0; j < normalsGim.img.width; ++j)
-		{
-			Vec4 currentNormal = gim->normals[i * normalsGim.img.width + j];
-			*(Vec4*)&normalsGim.img.data[i * normalsGim.img.width * normalsGim.img.channels + j * normalsGim.img.channels] = currentNormal;
-		}
+	ImagePlanes normalPlanes = imagePlanesCreateInArena(arena, gim->img.width, gim->img.height, 4, IMAGE_PLANES_FP32);
+	FloatImageData normalsImage = (FloatImageData) {(r32*)gim->normals, gim->img.width, gim->img.height, 4};
+	imagePlanesLoad(&normalPlanes, &normalsImage);
 
-	// Blur the fake geometry image 
-	GeometryImage resultGim = filterGeometryImageFilter(&normalsGim, blurIterations, ss, 1000.0f, RECURSIVE_FILTER, 0, false);
-
-	// Store results
-	for (s32 i = 0; i < normalsGim.img.height; ++i)
-		for (s32 j = 0; j < normalsGim.img.width; ++j)
-			blurredNormals[i * normalsGim.img.width + j] =
-				*(Vec4*)&resultGim.img.data[i * resultGim.img.width * resultGim.img.channels + j * resultGim.img.channels];
+	if (shouldBlur)
+	{
+		// Only the xyz channels are blurred, the filter works over 3 channels
+		ImagePlanes xyzPlanes = normalPlanes;
+		xyzPlanes.channels = 3;
+		filterImagePlanesRecursive(arena, &xyzPlanes, blurIterations, blurSS);
+	}
 
-	free(normalsGim.img.data);
-	gimFreeGeometryImage(&resultGim);
+	return normalPlanes;
+}
 
-	return blurredNormals;
+// Normalizes the normals stored in normalPlanes, so fillDomainTransform does not need to normalize each normal every time it is read
+static void normalizeNormalPlanes(ImagePlanes* normalPlanes)
+{
+	for (s32 i = 0; i < normalPlanes->height; ++i)
+		for (s32 j = 0; j < normalPlanes->width; ++j)
+		{
+			s32 index = i * normalPlanes->stride + j;
+			Vec4 normal = gmNormalizeVec4((Vec4) {normalPlanes->planes[0][index], normalPlanes->planes[1][index],
+				normalPlanes->planes[2][index], normalPlanes->planes[3][index]});
+			normalPlanes->planes[0][index] = normal.x;
+			normalPlanes->planes[1][index] = normal.y;
+			normalPlanes->planes[2][index] = normal.z;
+			normalPlanes->planes[3][index] = normal.w;
+		}
 }
 
 // Calculates and stores the domain transform of pixel 'currentPixel'
+// normals must be the normalized normals, see normalizeNormalPlanes
 static r32 fillDomainTransform(
 	const GeometryImage* gim,
-	const Vec4* normals,
+	const ImagePlanes* normals,
 	r32* dt,
 	DiscreteVec2 currentPixel,
 	DiscreteVec2 lastPixel,
@@ -51,25 +57,19 @@ static r32 fillDomainTransform(
 	r32 spatialFactor,
 	r32 rangeFactor)
 {
-	Vec3 currentPixelVal, lastPixelVal, penultPixelVal, nextPixelVal;
-	Vec4 currentNormal, lastNormal;
-	Vec3 lastTangent, currentTangent, nextTangent;
-	Vec3 lastTangentAverage, nextTangentAverage;
-	r32 curvatureValue, distanceValue, d;
+	r32 d;
 
-	currentPixelVal = *(Vec3*)&gim->img.data[currentPixel.y * gim->img.width * gim->img.channels + currentPixel.x * gim->img.channels];
-	lastPixelVal = *(Vec3*)&gim->img.data[lastPixel.y * gim->img.width * gim->img.channels + lastPixel.x * gim->img.channels];
-
-	// Get normals
-	currentNormal = normals[currentPixel.y * gim->img.width + currentPixel.x];
-	lastNormal = normals[lastPixel.y * gim->img.width + lastPixel.x];
-
-	// Normalize normals
-	currentNormal = gmNormalizeVec4(currentNormal);
-	lastNormal = gmNormalizeVec4(lastNormal);
+	s32 currentIndex = currentPixel.y * normals->stride + currentPixel.x;
+	s32 lastIndex = lastPixel.y * normals->stride + lastPixel.x;
 
 	// Get the curvatureValue - this is the length of the difference between normals
-	d = gmLengthVec4(gmSubtractVec4(currentNormal, lastNormal));
+	Vec4 normalDifference = (Vec4) {
+		normals->planes[0][currentIndex] - normals->planes[0][lastIndex],
+		normals->planes[1][currentIndex] - normals->planes[1][lastIndex],
+		normals->planes[2][currentIndex] - normals->planes[2][lastIndex],
+		normals->planes[3][currentIndex] - normals->planes[3][lastIndex]
+	};
+	d = gmLengthVec4(normalDifference);
 
 	dt[currentPixel.y * gim->img.width + currentPixel.x] = d;
 
@@ -113,28 +113,21 @@ static r32 fillDomainTransform(
 	return d;
 }
 
-// This function will calculate both horizontal and vertical domain transforms of geometry image 'gim'
-// filterMode tells which method should be used to calculate the transforms
-extern DomainTransform dtGenerateDomainTransforms(
+// Calculates the curvatures between neighbour normals, which are the domain transforms before they are scaled by
+// scaleDomainTransforms, into 'domainTransform'. Its arrays must be zero-initialized the first time
+// normalPlanes: the normalized normals of gim, see normalizeNormalPlanes
+// When dirtyRows is not 0, the horizontal and vertical steps only calculate the rows whose domain transforms depend on
+// the normals of a dirty row, the others keep their values. The C step and the Pi step are always calculated
+static void fillDomainTransforms(
+	DomainTransform domainTransform,
 	const GeometryImage* gim,
+	const ImagePlanes* normalPlanes,
+	const boolean* dirtyRows,
 	r32 spatialFactor,
-	r32 rangeFactor,
-	const BlurNormalsInformation* blurNormalsInformation)
+	r32 rangeFactor)
 {
-	DomainTransform domainTransform;
 	DiscreteVec2 nextPixel, currentPixel, lastPixel, penultPixel;
 	r32 lastValue;
-	// Normals are already defined inside the geometry image.
-	// However, we create this new array because they may be blurred to filter and we do not want to modify geometry image's normals
-	Vec4* normals;
-
-	domainTransform.vertical = calloc(1, sizeof(r32) * gim->img.width * gim->img.height);
-	domainTransform.horizontal = calloc(1, sizeof(r32) * gim->img.width * gim->img.height);
-
-	if (blurNormalsInformation && blurNormalsInformation->shouldBlur)
-		normals = blurNormals(gim, blurNormalsInformation->blurSS);
-	else
-		normals = gim->normals;
 
 	// HORIZONTAL STEP
 	for (s32 i = 1; i < gim->img.height - 1; ++i)
@@ -145,6 +138,9 @@ extern DomainTransform dtGenerateDomainTransforms(
 		// Get the mirror Y position
 		s32 mirrorYPosition = gim->img.height - 1 - i;
 
+		// Row i continues on its mirror row
+		if (dirtyRows && !dirtyRows[i] && !dirtyRows[mirrorYPosition]) continue;
+
 		// Fill initial conditions
 		currentPixel = (DiscreteVec2) {0, i};
 		lastPixel = (DiscreteVec2) {1, mirrorYPosition};
@@ -156,33 +152,40 @@ extern DomainTransform dtGenerateDomainTransforms(
 		for (s32 j = 0; j < gim->img.width; ++j)
 		{
 			currentPixel = (DiscreteVec2) {j, i};
-			lastValue = fillDomainTransform(gim, normals, domainTransform.horizontal, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
+			lastValue = fillDomainTransform(gim, normalPlanes, domainTransform.horizontal, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
 			penultPixel = lastPixel;
 			lastPixel = currentPixel;
 		}
 	}
 
 	// VERTICAL STEP
-	for (s32 j = 1; j < gim->img.width - 1; ++j)
+	// Column j goes from (j, tBorder) to (j, bBorder) and the pixel before (j, tBorder) is (mirrorX, 1).
+	// The image is walked row by row, which gives the same result as walking each column but is much more cache friendly
+	for (s32 i = 0; i < gim->img.height; ++i)
 	{
-		// If central line, avoid filtering process
-		if (j == gim->img.width / 2) continue;
+		// The pixels before the ones of row i are in row i - 1, or in row 1 for the top border
+		if (dirtyRows && !dirtyRows[i] && !dirtyRows[(i == 0) ? 1 : i - 1]) continue;
 
-		// Get the mirror X position
-		s32 mirrorXPosition = gim->img.width - 1 - j;
+		for (s32 j = 1; j < gim->img.width - 1; ++j)
+		{
+			// If central line, avoid filtering process
+			if (j == gim->img.width / 2) continue;
 
-		// Fill initial conditions
-		currentPixel = (DiscreteVec2) {j, 0};
-		lastPixel = (DiscreteVec2) {mirrorXPosition, 1};
-		penultPixel = (DiscreteVec2) {mirrorXPosition, 2};
+			// Get the mirror X position
+			s32 mirrorXPosition = gim->img.width - 1 - j;
 
-		// Filter from (j, tBorder) to (j, bBorder)
-		for (s32 i = 0; i < gim->img.height; ++i)
-		{
 			currentPixel = (DiscreteVec2) {j, i};
-			lastValue = fillDomainTransform(gim, normals, domainTransform.vertical, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
-			penultPixel = lastPixel;
-			lastPixel = currentPixel;
+			if (i == 0)
+			{
+				lastPixel = (DiscreteVec2) {mirrorXPosition, 1};
+				penultPixel = (DiscreteVec2) {mirrorXPosition, 2};
+			}
+			else
+			{
+				lastPixel = (DiscreteVec2) {j, i - 1};
+				penultPixel = (i == 1) ? (DiscreteVec2) {mirrorXPosition, 1} : (DiscreteVec2) {j, i - 2};
+			}
+			lastValue = fillDomainTransform(gim, normalPlanes, domainTransform.vertical, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
 		}
 	}
 
@@ -201,7 +204,7 @@ extern DomainTransform dtGenerateDomainTransforms(
 		// The last pixel will be to the right of the current pixel
 		r32* dt = (i == 0) ? domainTransform.horizontal : domainTransform.vertical;
 		currentPixel = (DiscreteVec2) {halfWidth, i};
-		lastValue = fillDomainTransform(gim, normals, dt, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
+		lastValue = fillDomainTransform(gim, normalPlanes, dt, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
 		penultPixel = lastPixel;
 		lastPixel = currentPixel;
 	}
@@ -212,7 +215,7 @@ extern DomainTransform dtGenerateDomainTransforms(
 		s32 mirrorXBorder = gim->img.width - 1 - j;
 
 		currentPixel = (DiscreteVec2) {j, gim->img.height - 1};
-		lastValue = fillDomainTransform(gim, normals, domainTransform.horizontal, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
+		lastValue = fillDomainTransform(gim, normalPlanes, domainTransform.horizontal, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
 		penultPixel = lastPixel;
 		lastPixel = currentPixel;
 	}
@@ -223,7 +226,7 @@ extern DomainTransform dtGenerateDomainTransforms(
 		s32 mirrorXBorder = gim->img.width - 1 - j;
 
 		currentPixel = (DiscreteVec2) {j, 0};
-		lastValue = fillDomainTransform(gim, normals, domainTransform.horizontal, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
+		lastValue = fillDomainTransform(gim, normalPlanes, domainTransform.horizontal, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
 		penultPixel = lastPixel;
 		lastPixel = currentPixel;
 	}
@@ -243,7 +246,7 @@ extern DomainTransform dtGenerateDomainTransforms(
 		// The last pixel will be on the bottom of the current pixel
 		r32* dt = (j == 0) ? domainTransform.vertical : domainTransform.horizontal;
 		currentPixel = (DiscreteVec2) {j, halfHeight};
-		lastValue = fillDomainTransform(gim, normals, dt, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
+		lastValue = fillDomainTransform(gim, normalPlanes, dt, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
 		penultPixel = lastPixel;
 		lastPixel = currentPixel;
 	}
@@ -254,7 +257,7 @@ extern DomainTransform dtGenerateDomainTransforms(
 		s32 mirrorYBorder = gim->img.height - 1 - i;
 
 		currentPixel = (DiscreteVec2) {gim->img.width - 1, i};
-		lastValue = fillDomainTransform(gim, normals, domainTransform.vertical, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
+		lastValue = fillDomainTransform(gim, normalPlanes, domainTransform.vertical, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
 		penultPixel = lastPixel;
 		lastPixel = currentPixel;
 	}
@@ -265,21 +268,91 @@ extern DomainTransform dtGenerateDomainTransforms(
 		s32 mirrorYBorder = gim->img.height - 1 - i;
 
 		currentPixel = (DiscreteVec2) {0, i};
-		lastValue = fillDomainTransform(gim, normals, domainTransform.vertical, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
+		lastValue = fillDomainTransform(gim, normalPlanes, domainTransform.vertical, currentPixel, lastPixel, penultPixel, spatialFactor, rangeFactor);
 		penultPixel = lastPixel;
 		lastPixel = currentPixel;
 	}
 
-	// FINAL STEP
-	for (s32 i = 0; i < gim->img.height; ++i)
-		for (s32 j = 0; j < gim->img.width; ++j)
+}
+
+// Writes the domain transforms calculated by fillDomainTransforms, in 'curvatures', to 'domainTransform'. Both may be the
+// same arrays
+static void scaleDomainTransforms(DomainTransform domainTransform, DomainTransform curvatures, s32 width, s32 height,
+	r32 spatialFactor, r32 rangeFactor)
+{
+	for (s32 i = 0; i < height; ++i)
+		for (s32 j = 0; j < width; ++j)
 		{
-			domainTransform.horizontal[i * gim->img.width + j] = 1.0f + (spatialFactor / rangeFactor) * domainTransform.horizontal[i * gim->img.width + j];
-			domainTransform.vertical[i * gim->img.width + j] = 1.0f + (spatialFactor / rangeFactor) * domainTransform.vertical[i * gim->img.width + j];
+			domainTransform.horizontal[i * width + j] = 1.0f + (spatialFactor / rangeFactor) * curvatures.horizontal[i * width + j];
+			domainTransform.vertical[i * width + j] = 1.0f + (spatialFactor / rangeFactor) * curvatures.vertical[i * width + j];
 		}
+}
 
-	if (blurNormalsInformation && blurNormalsInformation->shouldBlur)
-		free(normals);
+// Copies the normals of gim to planes allocated in 'arena', blurred if requested and normalized
+static ImagePlanes createNormalizedNormalPlanes(Arena* arena, const GeometryImage* gim,
+	const BlurNormalsInformation* blurNormalsInformation)
+{
+	// Normals are already defined inside the geometry image.
+	// However, we copy them because they may be blurred to filter and we do not want to modify geometry image's normals
+	boolean shouldBlur = blurNormalsInformation && blurNormalsInformation->shouldBlur;
+	ImagePlanes normalPlanes = createNormalPlanes(arena, gim, shouldBlur, shouldBlur ? blurNormalsInformation->blurSS : 0.0f);
+	normalizeNormalPlanes(&normalPlanes);
+	return normalPlanes;
+}
+
+// Calculates both horizontal and vertical domain transforms of geometry image 'gim' into 'domainTransform', whose
+// arrays must be zero-initialized. Scratch memory is allocated in 'arena'
+static void generateDomainTransforms(
+	Arena* arena,
+	DomainTransform domainTransform,
+	const GeometryImage* gim,
+	r32 spatialFactor,
+	r32 rangeFactor,
+	const BlurNormalsInformation* blurNormalsInformation)
+{
+	ImagePlanes normalPlanes = createNormalizedNormalPlanes(arena, gim, blurNormalsInformation);
+	fillDomainTransforms(domainTransform, gim, &normalPlanes, 0, spatialFactor, rangeFactor);
+	scaleDomainTransforms(domainTransform, domainTransform, gim->img.width, gim->img.height, spatialFactor, rangeFactor);
+}
+
+// This function will calculate both horizontal and vertical domain transforms of geometry image 'gim'
+// They must be released with dtDeleteDomainTransforms
+extern DomainTransform dtGenerateDomainTransforms(
+	const GeometryImage* gim,
+	r32 spatialFactor,
+	r32 rangeFactor,
+	const BlurNormalsInformation* blurNormalsInformation)
+{
+	DomainTransform domainTransform;
+	Arena scratch = {0};
+
+	domainTransform.vertical = calloc(1, sizeof(r32) * gim->img.width * gim->img.height);
+	domainTransform.horizontal = calloc(1, sizeof(r32) * gim->img.width * gim->img.height);
+
+	generateDomainTransforms(&scratch, domainTransform, gim, spatialFactor, rangeFactor, blurNormalsInformation);
+
+	arenaRelease(&scratch);
+	return domainTransform;
+}
+
+// Same as dtGenerateDomainTransforms, but the domain transforms and all scratch memory are allocated in 'arena'
+// The domain transforms are valid until the arena is reset and must not be released with dtDeleteDomainTransforms
+extern DomainTransform dtGenerateDomainTransformsInArena(
+	Arena* arena,
+	const GeometryImage* gim,
+	r32 spatialFactor,
+	r32 rangeFactor,
+	const BlurNormalsInformation* blurNormalsInformation)
+{
+	DomainTransform domainTransform;
+	size_t size = sizeof(r32) * gim->img.width * gim->img.height;
+
+	domainTransform.vertical = arenaAlloc(arena, size);
+	domainTransform.horizontal = arenaAlloc(arena, size);
+	memset(domainTransform.vertical, 0, size);
+	memset(domainTransform.horizontal, 0, size);
+
+	generateDomainTransforms(arena, domainTransform, gim, spatialFactor, rangeFactor, blurNormalsInformation);
 
 	return domainTransform;
 }
@@ -292,6 +365,105 @@ extern void dtDeleteDomainTransforms(DomainTransform dt)
 		free(dt.horizontal);
 }
 
+typedef struct
+{
+	DomainTransformSequence* sequence;
+	const ImagePlanes* normals;
+	r32 squaredThreshold;
+} SequenceCompareJob;
+
+// Pixels whose normal moved more than the threshold take the normal of the new frame. Their rows become dirty
+static void compareNormalRows(s32 firstRow, s32 lastRow, void* data)
+{
+	SequenceCompareJob* job = data;
+	ImagePlanes* reference = &job->sequence->referenceNormals;
+	const ImagePlanes* normals = job->normals;
+
+	for (s32 i = firstRow; i < lastRow; ++i)
+	{
+		boolean isDirty = false;
+		for (s32 j = 0; j < normals->width; ++j)
+		{
+			s32 index = i * normals->stride + j;
+			r32 squaredDistance = 0.0f;
+			for (s32 c = 0; c < 4; ++c)
+				squaredDistance += (normals->planes[c][index] - reference->planes[c][index]) *
+					(normals->planes[c][index] - reference->planes[c][index]);
+
+			if (squaredDistance > job->squaredThreshold)
+			{
+				for (s32 c = 0; c < 4; ++c)
+					reference->planes[c][index] = normals->planes[c][index];
+				isDirty = true;
+			}
+		}
+		job->sequence->dirtyRows[i] = isDirty;
+	}
+}
+
+// Calculates the domain transforms of the next frame of a sequence, gim, into 'domainTransform', whose arrays must have
+// the size of gim. The curvatures of the previous frame are kept: a pixel only takes the normal of the new frame when the
+// distance between it and the normal its curvatures were calculated from is greater than normalThreshold, and only the rows
+// with new normals are calculated again. Small changes of the normals, like noise, do not change the domain transforms,
+// so the filtered frames do not flicker. A normalThreshold of 0 gives the same domain transforms of dtGenerateDomainTransforms
+// The first frame, and frames after a change of size, spatial factor or range factor, are calculated from scratch
+extern void dtSequenceUpdate(
+	DomainTransformSequence* sequence,
+	DomainTransform domainTransform,
+	const GeometryImage* gim,
+	r32 spatialFactor,
+	r32 rangeFactor,
+	const BlurNormalsInformation* blurNormalsInformation,
+	r32 normalThreshold)
+{
+	s32 width = gim->img.width;
+	s32 height = gim->img.height;
+	arenaReset(&sequence->scratchArena);
+	ImagePlanes normalPlanes = createNormalizedNormalPlanes(&sequence->scratchArena, gim, blurNormalsInformation);
+
+	if (!sequence->dirtyRows || width != sequence->width || height != sequence->height || spatialFactor != sequence->spatialFactor ||
+		rangeFactor != sequence->rangeFactor)
+	{
+		size_t size = sizeof(r32) * width * height;
+		arenaReset(&sequence->persistentArena);
+		sequence->width = width;
+		sequence->height = height;
+		sequence->spatialFactor = spatialFactor;
+		sequence->rangeFactor = rangeFactor;
+		sequence->curvatures.vertical = arenaAlloc(&sequence->persistentArena, size);
+		sequence->curvatures.horizontal = arenaAlloc(&sequence->persistentArena, size);
+		memset(sequence->curvatures.vertical, 0, size);
+		memset(sequence->curvatures.horizontal, 0, size);
+		sequence->referenceNormals = imagePlanesCreateInArena(&sequence->persistentArena, width, height, 4, IMAGE_PLANES_FP32);
+		sequence->dirtyRows = arenaAlloc(&sequence->persistentArena, sizeof(boolean) * height);
+
+		for (s32 c = 0; c < 4; ++c)
+			memcpy(sequence->referenceNormals.planes[c], normalPlanes.planes[c], sizeof(r32) * height * normalPlanes.stride);
+		for (s32 i = 0; i < height; ++i)
+			sequence->dirtyRows[i] = true;
+	}
+	else
+	{
+		SequenceCompareJob job = {sequence, &normalPlanes, normalThreshold * normalThreshold};
+		parallelFor(height, SEQUENCE_ROWS_PER_TASK, compareNormalRows, &job);
+	}
+
+	sequence->numberOfDirtyRows = 0;
+	for (s32 i = 0; i < height; ++i)
+		sequence->numberOfDirtyRows += sequence->dirtyRows[i] ? 1 : 0;
+
+	fillDomainTransforms(sequence->curvatures, gim, &sequence->referenceNormals, sequence->dirtyRows, spatialFactor, rangeFactor);
+	scaleDomainTransforms(domainTransform, sequence->curvatures, width, height, spatialFactor, rangeFactor);
+}
+
+// Releases the memory of a sequence. It may still be used afterwards, starting from scratch
+extern void dtSequenceDestroy(DomainTransformSequence* sequence)
+{
+	arenaRelease(&sequence->persistentArena);
+	arenaRelease(&sequence->scratchArena);
+	*sequence = (DomainTransformSequence) {0};
+}
+
 extern FloatImageData dtGenerateDomainTransformsImage(
 	const GeometryImage* gim,
 	r32 spatialFactor,
@@ -334,12 +506,8 @@ extern FloatImageData dtGenerateNormalImage(
 	boolean shouldBlurNormals,
 	r32 blurSS)
 {
-	Vec4* normals;
-
-	if (shouldBlurNormals)
-		normals = blurNormals(gim, blurSS);
-	else
-		normals = gim->normals;
+	Arena scratch = {0};
+	ImagePlanes normalPlanes = createNormalPlanes(&scratch, gim, shouldBlurNormals, blurSS);
 
 	// Alloc texture
 	FloatImageData curvatureImage;
@@ -352,7 +520,8 @@ extern FloatImageData dtGenerateNormalImage(
 	for (s32 i = 0; i < gim->img.height; ++i)
 		for (s32 j = 0; j < gim->img.width; ++j)
 		{
-			Vec4 normal = *(Vec4*)&normals[i * curvatureImage.width + j];
+			s32 index = i * normalPlanes.stride + j;
+			Vec3 normal = (Vec3) {normalPlanes.planes[0][index], normalPlanes.planes[1][index], normalPlanes.planes[2][index]};
 
 			// Fill texture's pixel using desired value
 			curvatureImage.data[i * curvatureImage.width * curvatureImage.channels + j * curvatureImage.channels] = normal.x;
@@ -360,8 +529,7 @@ extern FloatImageData dtGenerateNormalImage(
 			curvatureImage.data[i * curvatureImage.width * curvatureImage.channels + j * curvatureImage.channels + 2] = normal.z;
 	}
 
-	if (shouldBlurNormals)
-		free(normals);
+	arenaRelease(&scratch);
 
 	return curvatureImage;
 }
\ No newline at end of file
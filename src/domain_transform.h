@@ -3,6 +3,7 @@
 #include "filter.h"
 
 typedef struct DomainTransform DomainTransform;
+typedef struct DomainTransformSequence DomainTransformSequence;
 
 struct DomainTransform
 {
@@ -10,12 +11,38 @@ struct DomainTransform
 	r32* horizontal;
 };
 
+// Domain transforms of the frames of an animation, which are geometry images of the same size, see dtSequenceUpdate
+// A zero-initialized DomainTransformSequence is a valid empty sequence
+struct DomainTransformSequence
+{
+	s32 width, height;
+	r32 spatialFactor, rangeFactor;
+	// Memory that lives as long as the sequence: curvatures, reference normals and dirty rows
+	Arena persistentArena;
+	// Scratch memory of each update
+	Arena scratchArena;
+	// Domain transforms before they are scaled by the spatial and range factors
+	DomainTransform curvatures;
+	// Normalized normals the curvatures were calculated from
+	ImagePlanes referenceNormals;
+	boolean* dirtyRows;
+	// Rows whose normals changed in the last update
+	s32 numberOfDirtyRows;
+};
+
 extern DomainTransform dtGenerateDomainTransforms(
 	const GeometryImage* gim,
 	r32 spatialFactor,
 	r32 rangeFactor,
 	const BlurNormalsInformation* blurInformation);
 
+extern DomainTransform dtGenerateDomainTransformsInArena(
+	Arena* arena,
+	const GeometryImage* gim,
+	r32 spatialFactor,
+	r32 rangeFactor,
+	const BlurNormalsInformation* blurInformation);
+
 extern FloatImageData dtGenerateDomainTransformsImage(
 	const GeometryImage* gim,
 	r32 spatialFactor,
@@ -29,4 +56,14 @@ extern FloatImageData dtGenerateNormalImage(
 
 extern void dtDeleteDomainTransforms(DomainTransform dt);
 
+extern void dtSequenceUpdate(
+	DomainTransformSequence* sequence,
+	DomainTransform domainTransform,
+	const GeometryImage* gim,
+	r32 spatialFactor,
+	r32 rangeFactor,
+	const BlurNormalsInformation* blurInformation,
+	r32 normalThreshold);
+extern void dtSequenceDestroy(DomainTransformSequence* sequence);
+
 #endif
\ No newline at end of file
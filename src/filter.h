@@ -1,14 +1,37 @@
 #ifndef GIMMESH_FILTER_H
 #define GIMMESH_FILTER_H
 #include "gim.h"
+#include "arena.h"
+#include "image_planes.h"
+
+// A pixel of the seams has at most 3 mirrors (corners)
+#define FILTER_PATH_MAX_MIRRORS 3
+// Most iterations run by an adaptive filter, see filterGeometryImageFilterAdaptive
+#define FILTER_MAX_ADAPTIVE_ITERATIONS 16
+// Upper bound for the channels of the attributes filtered with the positions, see filterGeometryImageFilterWithAttributes
+#define FILTER_MAX_ATTRIBUTES (IMAGE_PLANES_MAX_CHANNELS - 3)
 
 typedef enum FilterMode FilterMode;
 typedef struct BlurNormalsInformation BlurNormalsInformation;
+typedef struct FilterRegion FilterRegion;
+typedef struct FilterTimes FilterTimes;
+typedef struct FilterConvergence FilterConvergence;
+typedef struct FilterContext FilterContext;
+typedef struct FilterPathEntry FilterPathEntry;
+typedef struct FilterPath FilterPath;
+typedef struct FilterPaths FilterPaths;
+typedef struct FilterPlanOptions FilterPlanOptions;
+typedef struct FilterParameters FilterParameters;
+typedef struct FilterPlan FilterPlan;
+// Defined in domain_transform.h, which includes this header
+struct DomainTransform;
 
 enum FilterMode
 {
 	RECURSIVE_FILTER = 0,
 	CURVATURE_FILTER = 1,
+	// Normalized convolution: box filters over the domain transforms of CURVATURE_FILTER, see filterLoopKernel
+	NORMALIZED_CONVOLUTION_FILTER = 2,
 };
 
 struct BlurNormalsInformation
@@ -17,6 +40,110 @@ struct BlurNormalsInformation
 	r32 blurSS;
 };
 
+// Time, in seconds, spent in each stage of the filter
+struct FilterTimes
+{
+	r64 domainTransforms;
+	r64 horizontalStep;
+	r64 cStep;
+	r64 verticalStep;
+	r64 piStep;
+	r64 total;
+};
+
+// Convergence curve of an adaptive filter
+struct FilterConvergence
+{
+	s32 numIterations;
+	// Whether the change of the last iteration is below the tolerance. Otherwise, the filter stopped at the maximum number
+	// of iterations, or the last iteration changed more than expected
+	boolean converged;
+	// Standard deviation of each iteration. Not used in RECURSIVE_FILTER mode
+	r32 standardDeviations[FILTER_MAX_ADAPTIVE_ITERATIONS];
+	// Root mean square and maximum of the displacement of the vertices written by the H-Filter and the V-Filter in each
+	// iteration
+	r32 rmsChanges[FILTER_MAX_ADAPTIVE_ITERATIONS];
+	r32 maxChanges[FILTER_MAX_ADAPTIVE_ITERATIONS];
+};
+
+// Owns the scratch memory of the filter: domain transforms, blurred normals, image planes and the buffers of the steps.
+// It may be reused by any number of calls. A zero-initialized FilterContext is a valid empty context
+struct FilterContext
+{
+	Arena arena;
+};
+
+// Pixel visited by a path of the C-Filter or of the Pi-Filter
+struct FilterPathEntry
+{
+	// Index of the pixel in the image planes (y * stride + x)
+	s32 pixel;
+	// Index of the domain transform used to reach the pixel (y * width + x) and whether it is a vertical one
+	s32 domainTransformIndex;
+	boolean verticalDomainTransform;
+	// Border pixels that are the same vertex and receive the same value
+	s32 numberOfMirrors;
+	s32 mirrors[FILTER_PATH_MAX_MIRRORS];
+};
+
+struct FilterPath
+{
+	FilterPathEntry* entries;
+	s32 length;
+};
+
+// The C-Filter and the Pi-Filter filter two paths each
+struct FilterPaths
+{
+	FilterPath c[2];
+	FilterPath pi[2];
+};
+
+// Options that are fixed for all executions of a plan
+struct FilterPlanOptions
+{
+	s32 numIterations;
+	FilterMode filterMode;
+	boolean blurNormals;
+	// IMAGE_PLANES_FP16 stores the image and the domain transforms read by the H-Filter and the V-Filter as half floats
+	// while filtering, which halves their memory traffic. Pixels are still filtered in floats, but each stored value has a
+	// relative error of up to 2^-11. IMAGE_PLANES_FP32 (0) is the default
+	ImagePlanesPrecision precision;
+	// When greater than 0, the filter is adaptive and numIterations is the maximum number of iterations, see
+	// filterGeometryImageFilterAdaptive, which does not support RECURSIVE_FILTER. 0 runs exactly numIterations iterations
+	r32 convergenceTolerance;
+};
+
+// Parameters that may change in each execution of a plan
+struct FilterParameters
+{
+	r32 spatialFactor;
+	r32 rangeFactor;
+	r32 blurSS;
+};
+
+// Everything that is needed to filter geometry images of a given size, see filterPlanCreate
+struct FilterPlan
+{
+	s32 width, height;
+	FilterPlanOptions options;
+	// Memory that lives as long as the plan: paths and RF feedback coefficients
+	Arena persistentArena;
+	FilterPaths paths;
+	r32* rfCoefficients;
+	// Spatial factor of rfCoefficients
+	r32 rfSpatialFactor;
+	// Scratch memory of each execution
+	FilterContext context;
+};
+
+// Rectangle in pixel coordinates
+struct FilterRegion
+{
+	s32 x, y;
+	s32 width, height;
+};
+
 extern GeometryImage filterGeometryImageFilter(
 	const GeometryImage* originalGim,
 	s32 numIterations,
@@ -26,4 +153,80 @@ extern GeometryImage filterGeometryImageFilter(
 	const BlurNormalsInformation* blurNormalsInformation,
 	boolean printTime);
 
+extern GeometryImage filterGeometryImageFilterAdaptive(
+	const GeometryImage* originalGim,
+	s32 maxIterations,
+	r32 convergenceTolerance,
+	r32 spatialFactor,
+	r32 rangeFactor,
+	FilterMode filterMode,
+	const BlurNormalsInformation* blurNormalsInformation,
+	boolean printTime);
+
+extern void filterGeometryImageFilterWithContext(
+	FilterContext* context,
+	const GeometryImage* originalGim,
+	GeometryImage* filteredGim,
+	s32 numIterations,
+	r32 spatialFactor,
+	r32 rangeFactor,
+	FilterMode filterMode,
+	const BlurNormalsInformation* blurNormalsInformation,
+	boolean printTime);
+
+extern void filterGeometryImageFilterWithAttributes(
+	FilterContext* context,
+	const GeometryImage* originalGim,
+	GeometryImage* filteredGim,
+	FloatImageData* attributes,
+	s32 numIterations,
+	r32 spatialFactor,
+	r32 rangeFactor,
+	FilterMode filterMode,
+	const BlurNormalsInformation* blurNormalsInformation,
+	boolean printTime);
+
+extern void filterContextDestroy(FilterContext* context);
+
+extern void filterImagePlanesRecursive(Arena* arena, ImagePlanes* img, s32 numIterations, r32 spatialFactor);
+
+extern FilterPlan filterPlanCreate(s32 width, s32 height, const FilterPlanOptions* options);
+extern s32 filterExecute(FilterPlan* plan, const GeometryImage* originalGim, GeometryImage* filteredGim, const FilterParameters* parameters);
+extern s32 filterExecuteWithDomainTransform(
+	FilterPlan* plan,
+	const GeometryImage* originalGim,
+	GeometryImage* filteredGim,
+	const FilterParameters* parameters,
+	const struct DomainTransform* domainTransform);
+extern void filterPlanDestroy(FilterPlan* plan);
+
+extern r32 filterGetNormalsBlurSS(r32 rangeFactor);
+
+// Returns the times of the last call to filterGeometryImageFilter in the calling thread
+extern FilterTimes filterGetLastTimes();
+// Returns the convergence curve of the last adaptive filter in the calling thread
+extern FilterConvergence filterGetLastConvergence();
+
+extern GeometryImage filterGeometryImageFilterMultiscale(
+	const GeometryImage* originalGim,
+	s32 numIterations,
+	r32 spatialFactor,
+	r32 rangeFactor,
+	FilterMode filterMode,
+	const BlurNormalsInformation* blurNormalsInformation,
+	s32 numLevels,
+	boolean printTime);
+
+extern FilterRegion* filterGeometryImageFilterRegion(
+	FilterContext* context,
+	const GeometryImage* originalGim,
+	GeometryImage* filteredGim,
+	s32 numIterations,
+	r32 spatialFactor,
+	r32 rangeFactor,
+	FilterMode filterMode,
+	const BlurNormalsInformation* blurNormalsInformation,
+	FilterRegion region,
+	boolean printTime);
+
 #endif
\ No newline at end of file
@@ -2,7 +2,9 @@
 #include "gim.h"
 #include "float.h"
 #include "util.h"
+#include "parallel.h"
 #include <stdio.h>
+#include <math.h>
 
 // Parses a .gim file into a GeometryImage
 extern int gimParseGeometryImageFile(GeometryImage* gim, const u8* path)
@@ -38,7 +40,8 @@ extern void gimGeometryImageUpdate3D(GeometryImage* gim)
 	// Create arrays
 	gim->vertices = array_create(Vertex, 1);
 	gim->indexes = array_create(u32, 1);
-	gim->normals = malloc(sizeof(Vec4) * gim->img.width * gim->img.height);
+	if (!gim->normals)
+		gim->normals = malloc(sizeof(Vec4) * gim->img.width * gim->img.height);
 
 	// Initializes vertexMap with -1
 	for (s32 i = 0; i < gim->img.width * gim->img.height; ++i)
@@ -164,6 +167,60 @@ extern void gimGeometryImageUpdate3D(GeometryImage* gim)
 	free(vertexMap);
 }
 
+typedef struct
+{
+	const FloatImageData* img;
+	Vec4* normals;
+} NormalsJob;
+
+// Position of pixel <x, y>, where x and y may be one pixel outside of the image. The spherical geometry image continues
+// on the other side of the border: (-1, y) is (1, h - 1 - y), (x, -1) is (w - 1 - x, 1) and so on
+static Vec3 getSphericalPosition(const FloatImageData* img, s32 x, s32 y)
+{
+	if (x < 0 || x > img->width - 1)
+	{
+		x = (x < 0) ? 1 : img->width - 2;
+		y = img->height - 1 - y;
+	}
+	if (y < 0 || y > img->height - 1)
+	{
+		x = img->width - 1 - x;
+		y = (y < 0) ? 1 : img->height - 2;
+	}
+	return *(Vec3*)&img->data[(y * img->width + x) * img->channels];
+}
+
+static void estimateNormalsOfRows(s32 firstRow, s32 lastRow, void* data)
+{
+	NormalsJob* job = data;
+	const FloatImageData* img = job->img;
+
+	for (s32 y = firstRow; y < lastRow; ++y)
+		for (s32 x = 0; x < img->width; ++x)
+		{
+			Vec3 du = gmSubtractVec3(getSphericalPosition(img, x + 1, y), getSphericalPosition(img, x - 1, y));
+			Vec3 dv = gmSubtractVec3(getSphericalPosition(img, x, y + 1), getSphericalPosition(img, x, y - 1));
+			Vec3 normal = gmCrossProduct(du, dv);
+			r32 length = gmLengthVec3(normal);
+			if (length > 0.0f)
+				normal = gmScalarProductVec3(1.0f / length, normal);
+			job->normals[y * img->width + x] = (Vec4) {normal.x, normal.y, normal.z, 0.0f};
+		}
+}
+
+// Fills gim->normals, which is allocated if needed, with normals estimated from the positions only, with central
+// differences over the spherical topology of the geometry image. Unlike gimGeometryImageUpdate3D, no vertices or triangles
+// are built, so this is enough for the domain transforms of the filter when the mesh is not rendered. Mirrored border
+// pixels get the same normal. Rows are processed in parallel
+extern void gimEstimateNormals(GeometryImage* gim)
+{
+	if (!gim->normals)
+		gim->normals = malloc(sizeof(Vec4) * gim->img.width * gim->img.height);
+
+	NormalsJob job = {&gim->img, gim->normals};
+	parallelFor(gim->img.height, 16, estimateNormalsOfRows, &job);
+}
+
 // Creates a mesh ready to render based on the geometry image
 extern Mesh gimGeometryImageToMesh(const GeometryImage* gim, Vec4 color)
 {
@@ -178,7 +235,8 @@ extern Mesh gimGeometryImageToMesh(const GeometryImage* gim, Vec4 color)
 		gim->indexes,
 		array_get_length(gim->indexes),
 		&normalInfo,
-		color);
+		color,
+		VERTEX_LAYOUT_COMPACT);
 
 	return mesh;
 }
@@ -208,22 +266,36 @@ extern void gimExportToObjFile(const GeometryImage* gim, const s8* objPath)
 	fclose(fp);
 }
 
-static r32 normalize(r32 v, r32 min, r32 max)
-{
-	return (v - min) / (max - min);
-}
+// Rows processed by each task when normalizing images for visualization
+#define VISUALIZATION_ROWS_PER_TASK 16
 
-extern FloatImageData gimNormalizeImageForVisualization(const FloatImageData* gimImage)
+typedef struct
+{
+	const FloatImageData* img;
+	ImageData* result;
+	// Minimum and maximum of each channel, first for each task and then for the whole image
+	Vec3* minimums;
+	Vec3* maximums;
+	Vec3 scale;
+} VisualizationJob;
+
+static void findMinMaxOfRows(s32 firstTask, s32 lastTask, void* data)
 {
-	r32 rMin = FLT_MAX, gMin = FLT_MAX, bMin = FLT_MAX;
-	r32 rMax = -FLT_MAX, gMax = -FLT_MAX, bMax = -FLT_MAX;
+	VisualizationJob* job = data;
+	const FloatImageData* img = job->img;
 
-	for (s32 i = 0; i < gimImage->height; ++i)
-		for (s32 j = 0; j < gimImage->width; ++j)
+	for (s32 task = firstTask; task < lastTask; ++task)
+	{
+		s32 firstRow = task * VISUALIZATION_ROWS_PER_TASK;
+		s32 lastRow = firstRow + VISUALIZATION_ROWS_PER_TASK < img->height ? firstRow + VISUALIZATION_ROWS_PER_TASK : img->height;
+		r32 rMin = FLT_MAX, gMin = FLT_MAX, bMin = FLT_MAX;
+		r32 rMax = -FLT_MAX, gMax = -FLT_MAX, bMax = -FLT_MAX;
+
+		for (s32 i = firstRow * img->width; i < lastRow * img->width; ++i)
 		{
-			r32 r = gimImage->data[gimImage->width * gimImage->channels * i + gimImage->channels * j + 0];
-			r32 g = gimImage->data[gimImage->width * gimImage->channels * i + gimImage->channels * j + 1];
-			r32 b = gimImage->data[gimImage->width * gimImage->channels * i + gimImage->channels * j + 2];
+			r32 r = img->data[i * img->channels + 0];
+			r32 g = img->data[i * img->channels + 1];
+			r32 b = img->data[i * img->channels + 2];
 
 			if (r < rMin) rMin = r;
 			if (g < gMin) gMin = g;
@@ -233,100 +305,155 @@ extern FloatImageData gimNormalizeImageForVisualization(const FloatImageData* gi
 			if (b > bMax) bMax = b;
 		}
 
-	FloatImageData result;
-	result.data = malloc(gimImage->width * gimImage->height * 4 * sizeof(r32));
+		job->minimums[task] = (Vec3){rMin, gMin, bMin};
+		job->maximums[task] = (Vec3){rMax, gMax, bMax};
+	}
+}
+
+static r32 getQuantizationScale(r32 min, r32 max)
+{
+	return max > min ? 255.0f / (max - min) : 0.0f;
+}
+
+static void quantizeRows(s32 firstTask, s32 lastTask, void* data)
+{
+	VisualizationJob* job = data;
+	const FloatImageData* img = job->img;
+	Vec3 min = job->minimums[0];
+	Vec3 scale = job->scale;
+
+	s32 firstRow = firstTask * VISUALIZATION_ROWS_PER_TASK;
+	s32 lastRow = lastTask * VISUALIZATION_ROWS_PER_TASK < img->height ? lastTask * VISUALIZATION_ROWS_PER_TASK : img->height;
+
+	for (s32 i = firstRow * img->width; i < lastRow * img->width; ++i)
+	{
+		job->result->data[i * 4 + 0] = (u8)((img->data[i * img->channels + 0] - min.x) * scale.x + 0.5f);
+		job->result->data[i * 4 + 1] = (u8)((img->data[i * img->channels + 1] - min.y) * scale.y + 0.5f);
+		job->result->data[i * 4 + 2] = (u8)((img->data[i * img->channels + 2] - min.z) * scale.z + 0.5f);
+		job->result->data[i * 4 + 3] = 255;
+	}
+}
+
+// Maps each of the first three channels from [min, max] of the channel to [0, 255] and returns a RGBA8 image, which can be
+// saved or uploaded as a texture directly. The min/max reduction and the quantization run in parallel
+extern ImageData gimNormalizeImageForVisualization(const FloatImageData* gimImage)
+{
+	s32 numberOfTasks = (gimImage->height + VISUALIZATION_ROWS_PER_TASK - 1) / VISUALIZATION_ROWS_PER_TASK;
+
+	ImageData result;
+	result.data = malloc(gimImage->width * gimImage->height * 4 * sizeof(u8));
 	result.height = gimImage->height;
 	result.width = gimImage->width;
 	result.channels = 4;
 
-	for (s32 i = 0; i < gimImage->height; ++i)
-		for (s32 j = 0; j < gimImage->width; ++j)
-		{
-			r32 r = gimImage->data[gimImage->width * gimImage->channels * i + gimImage->channels * j + 0];
-			r32 g = gimImage->data[gimImage->width * gimImage->channels * i + gimImage->channels * j + 1];
-			r32 b = gimImage->data[gimImage->width * gimImage->channels * i + gimImage->channels * j + 2];
-
-			result.data[result.width * result.channels * i + result.channels * j + 0] = normalize(r, rMin, rMax);
-			result.data[result.width * result.channels * i + result.channels * j + 1] = normalize(g, gMin, gMax);
-			result.data[result.width * result.channels * i + result.channels * j + 2] = normalize(b, bMin, bMax);
-			result.data[result.width * result.channels * i + result.channels * j + 3] = 1.0f;
-		}
+	VisualizationJob job;
+	job.img = gimImage;
+	job.result = &result;
+	job.minimums = malloc(sizeof(Vec3) * numberOfTasks);
+	job.maximums = malloc(sizeof(Vec3) * numberOfTasks);
+
+	parallelFor(numberOfTasks, 1, findMinMaxOfRows, &job);
 
+	for (s32 task = 1; task < numberOfTasks; ++task)
+	{
+		Vec3 min = job.minimums[task], max = job.maximums[task];
+		if (min.x < job.minimums[0].x) job.minimums[0].x = min.x;
+		if (min.y < job.minimums[0].y) job.minimums[0].y = min.y;
+		if (min.z < job.minimums[0].z) job.minimums[0].z = min.z;
+		if (max.x > job.maximums[0].x) job.maximums[0].x = max.x;
+		if (max.y > job.maximums[0].y) job.maximums[0].y = max.y;
+		if (max.z > job.maximums[0].z) job.maximums[0].z = max.z;
+	}
+
+	job.scale.x = getQuantizationScale(job.minimums[0].x, job.maximums[0].x);
+	job.scale.y = getQuantizationScale(job.minimums[0].y, job.maximums[0].y);
+	job.scale.z = getQuantizationScale(job.minimums[0].z, job.maximums[0].z);
+
+	parallelFor(numberOfTasks, 1, quantizeRows, &job);
+
+	free(job.minimums);
+	free(job.maximums);
 	return result;
 }
 
 extern void gimNormalizeAndSave(const GeometryImage* gim, const s8* imagePath)
 {
-	FloatImageData normalizedTexture = gimNormalizeImageForVisualization(&gim->img);
-	graphicsFloatImageSave(imagePath, &normalizedTexture);
-	graphicsFloatImageFree(&normalizedTexture);
+	ImageData normalizedTexture = gimNormalizeImageForVisualization(&gim->img);
+	graphicsImageSave(imagePath, &normalizedTexture);
+	graphicsImageFree(&normalizedTexture);
 }
 
-static Vec3 generateNoiseVector(r32 weight)
+typedef struct
 {
-	Vec3 r;
-	r.x = utilRandomFloat(-1.0f, 1.0f);
-	r.y = utilRandomFloat(-1.0f, 1.0f);
-	r.z = utilRandomFloat(-1.0f, 1.0f);
-	r = gmNormalizeVec3(r);
-	r32 a = utilRandomFloat(-weight, weight);
-	return gmScalarProductVec3(a, r);
+	const FloatImageData* img;
+	FloatImageData* noisyImg;
+	r32 weight;
+	u64 seed;
+} NoiseJob;
+
+// Border pixels are the same vertex as their mirrors: (0, y) and (0, height - 1 - y), (x, 0) and (width - 1 - x, 0), the same
+// for the last column/row, and the four corners. Returns the pixel that represents (x, y), so mirrors get the same noise
+static s32 getNoisePixel(s32 x, s32 y, s32 width, s32 height)
+{
+	boolean isBorderColumn = x == 0 || x == width - 1;
+	boolean isBorderRow = y == 0 || y == height - 1;
+
+	if (isBorderColumn && isBorderRow)
+		return 0;
+	if (isBorderColumn && y > height - 1 - y)
+		y = height - 1 - y;
+	if (isBorderRow && x > width - 1 - x)
+		x = width - 1 - x;
+	return y * width + x;
 }
 
-extern GeometryImage gimAddNoise(const GeometryImage* gim, r32 noiseIntensity)
+// Random direction scaled by a random length in [-weight, weight). It depends only on (seed, pixel)
+static Vec3 generateNoiseVector(u64 seed, u64 pixel, r32 weight)
 {
-	GeometryImage noisyGim = gimCopyGeometryImage(gim, false);
+	u64 r0 = utilCounterRandom(seed, 2 * pixel);
+	u64 r1 = utilCounterRandom(seed, 2 * pixel + 1);
 
-	r32 noiseWeightNormalized = noiseIntensity / 1000.0f;
+	Vec3 r;
+	r.x = utilBitsToFloat((u32)r0, -1.0f, 1.0f);
+	r.y = utilBitsToFloat((u32)(r0 >> 32), -1.0f, 1.0f);
+	r.z = utilBitsToFloat((u32)r1, -1.0f, 1.0f);
+	r32 a = utilBitsToFloat((u32)(r1 >> 32), -weight, weight);
+
+	r32 lengthSquared = r.x * r.x + r.y * r.y + r.z * r.z;
+	if (lengthSquared == 0.0f)
+		return (Vec3){0.0f, 0.0f, 0.0f};
+	return gmScalarProductVec3(a / sqrtf(lengthSquared), r);
+}
 
-	// Add noise to regular vertices
-	for (s32 i = 1; i < noisyGim.img.height - 1; ++i)
-		for (s32 j = 1; j < noisyGim.img.width - 1; ++j)
+static void addNoiseToRows(s32 firstRow, s32 lastRow, void* data)
+{
+	NoiseJob* job = data;
+	s32 width = job->img->width;
+	s32 height = job->img->height;
+	s32 channels = job->img->channels;
+
+	for (s32 y = firstRow; y < lastRow; ++y)
+		for (s32 x = 0; x < width; ++x)
 		{
-			Vec3 vertex = *(Vec3*)&noisyGim.img.data[i * noisyGim.img.width * noisyGim.img.channels + j * noisyGim.img.channels];
-			vertex = gmAddVec3(vertex, generateNoiseVector(noiseWeightNormalized));
-			*(Vec3*)&noisyGim.img.data[i * noisyGim.img.width * noisyGim.img.channels + j * noisyGim.img.channels] = vertex;
+			s32 noisePixel = getNoisePixel(x, y, width, height);
+			Vec3 vertex = *(Vec3*)&job->img->data[noisePixel * channels];
+			vertex = gmAddVec3(vertex, generateNoiseVector(job->seed, noisePixel, job->weight));
+			*(Vec3*)&job->noisyImg->data[(y * width + x) * channels] = vertex;
 		}
+}
 
-	// Add noise to left/right border vertices
-	for (s32 i = 1; i < noisyGim.img.height - 1; ++i)
-	{
-		s32 mirrorYPosition = noisyGim.img.height - i - 1;
-
-		Vec3 vertex = *(Vec3*)&noisyGim.img.data[i * noisyGim.img.width * noisyGim.img.channels + 0 * noisyGim.img.channels];
-		vertex = gmAddVec3(vertex, generateNoiseVector(noiseWeightNormalized));
-		*(Vec3*)&noisyGim.img.data[i * noisyGim.img.width * noisyGim.img.channels + 0 * noisyGim.img.channels] = vertex;
-		*(Vec3*)&noisyGim.img.data[mirrorYPosition * noisyGim.img.width * noisyGim.img.channels + 0 * noisyGim.img.channels] = vertex;
-
-		vertex = *(Vec3*)&noisyGim.img.data[i * noisyGim.img.width * noisyGim.img.channels + (noisyGim.img.width - 1) * noisyGim.img.channels];
-		vertex = gmAddVec3(vertex, generateNoiseVector(noiseWeightNormalized));
-		*(Vec3*)&noisyGim.img.data[i * noisyGim.img.width * noisyGim.img.channels + (noisyGim.img.width - 1) * noisyGim.img.channels] = vertex;
-		*(Vec3*)&noisyGim.img.data[mirrorYPosition * noisyGim.img.width * noisyGim.img.channels + (noisyGim.img.width - 1) * noisyGim.img.channels] = vertex;
-	}
-
-	// Add noise to top/bottom vertices
-	for (s32 j = 1; j < noisyGim.img.width - 1; ++j)
-	{
-		s32 mirrorXPosition = noisyGim.img.width - j - 1;
-
-		Vec3 vertex = *(Vec3*)&noisyGim.img.data[0 * noisyGim.img.width * noisyGim.img.channels + j * noisyGim.img.channels];
-		vertex = gmAddVec3(vertex, generateNoiseVector(noiseWeightNormalized));
-		*(Vec3*)&noisyGim.img.data[0 * noisyGim.img.width * noisyGim.img.channels + j * noisyGim.img.channels] = vertex;
-		*(Vec3*)&noisyGim.img.data[0 * noisyGim.img.width * noisyGim.img.channels + mirrorXPosition * noisyGim.img.channels] = vertex;
-
-		vertex = *(Vec3*)&noisyGim.img.data[(noisyGim.img.height - 1) * noisyGim.img.width * noisyGim.img.channels + j * noisyGim.img.channels];
-		vertex = gmAddVec3(vertex, generateNoiseVector(noiseWeightNormalized));
-		*(Vec3*)&noisyGim.img.data[(noisyGim.img.height - 1) * noisyGim.img.width * noisyGim.img.channels + j * noisyGim.img.channels] = vertex;
-		*(Vec3*)&noisyGim.img.data[(noisyGim.img.height - 1) * noisyGim.img.width * noisyGim.img.channels + mirrorXPosition * noisyGim.img.channels] = vertex;
-	}
+// Adds random noise to the vertices. The noise of each vertex depends only on the seed and on its position in the image,
+// so the same seed always generates the same noisy geometry image, regardless of the number of threads
+extern GeometryImage gimAddNoise(const GeometryImage* gim, r32 noiseIntensity, u64 seed)
+{
+	GeometryImage noisyGim = gimCopyGeometryImage(gim, false);
 
-	// Add noise to corner vertices
-	Vec3 vertex = *(Vec3*)&noisyGim.img.data[0 * noisyGim.img.width * noisyGim.img.channels + 0 * noisyGim.img.channels];
-	vertex = gmAddVec3(vertex, generateNoiseVector(noiseWeightNormalized));
-	*(Vec3*)&noisyGim.img.data[0 * noisyGim.img.width * noisyGim.img.channels + 0 * noisyGim.img.channels] = vertex;
-	*(Vec3*)&noisyGim.img.data[0 * noisyGim.img.width * noisyGim.img.channels + (noisyGim.img.width - 1) * noisyGim.img.channels] = vertex;
-	*(Vec3*)&noisyGim.img.data[(noisyGim.img.height - 1) * noisyGim.img.width * noisyGim.img.channels + 0 * noisyGim.img.channels] = vertex;
-	*(Vec3*)&noisyGim.img.data[(noisyGim.img.height - 1) * noisyGim.img.width * noisyGim.img.channels + (noisyGim.img.width - 1) * noisyGim.img.channels] = vertex;
+	NoiseJob job;
+	job.img = &gim->img;
+	job.noisyImg = &noisyGim.img;
+	job.weight = noiseIntensity / 1000.0f;
+	job.seed = seed;
+	parallelFor(noisyGim.img.height, 16, addNoiseToRows, &job);
 
 	return noisyGim;
 }
@@ -342,67 +469,64 @@ extern void gimFreeGeometryImage(GeometryImage* gim)
 		free(gim->normals);
 }
 
-static void checkNumberOfMatches(const FloatImageData* gimImage, s32 x, s32 y)
+// Compares the vertex at <x, y> with the vertex at <mirrorX, mirrorY> and records the result
+static void checkBorderPair(const FloatImageData* gimImage, s32 x, s32 y, s32 mirrorX, s32 mirrorY, r32 epsilon,
+	GimBorderCheckResult* result)
 {
-	DiscreteVec2* matches = array_create(DiscreteVec2, 1);
-	Vec3 vertex = *(Vec3*)&gimImage->data[y * gimImage->width * gimImage->channels + x * gimImage->channels];
+	const r32* vertex = &gimImage->data[(y * gimImage->width + x) * gimImage->channels];
+	const r32* mirror = &gimImage->data[(mirrorY * gimImage->width + mirrorX) * gimImage->channels];
 
-	for (s32 i = 0; i < gimImage->height; ++i)
+	r32 distance = 0.0f;
+	for (s32 i = 0; i < 3; ++i)
 	{
-		DiscreteVec2 currentPosition = (DiscreteVec2) {i, 0};
-		Vec3 currentVertex = *(Vec3*)&gimImage->data[currentPosition.y * gimImage->width * gimImage->channels + currentPosition.x * gimImage->channels];
-		if (gmEqualVec3(currentVertex, vertex))
-			array_push(matches, &currentPosition);
-
-		currentPosition = (DiscreteVec2) {i, gimImage->width - 1};
-		currentVertex = *(Vec3*)&gimImage->data[currentPosition.y * gimImage->width * gimImage->channels + currentPosition.x * gimImage->channels];
-		if (gmEqualVec3(currentVertex, vertex))
-			array_push(matches, &currentPosition);
+		r32 difference = fabsf(vertex[i] - mirror[i]);
+		if (difference > distance)
+			distance = difference;
 	}
 
-	for (s32 j = 1; j < gimImage->width - 1; ++j)
-	{
-		DiscreteVec2 currentPosition = (DiscreteVec2) {0, j};
-		Vec3 currentVertex = *(Vec3*)&gimImage->data[currentPosition.y * gimImage->width * gimImage->channels + currentPosition.x * gimImage->channels];
-		if (gmEqualVec3(currentVertex, vertex))
-			array_push(matches, &currentPosition);
-
-		currentPosition = (DiscreteVec2) {gimImage->height - 1, j};
-		currentVertex = *(Vec3*)&gimImage->data[currentPosition.y * gimImage->width * gimImage->channels + currentPosition.x * gimImage->channels];
-		if (gmEqualVec3(currentVertex, vertex))
-			array_push(matches, &currentPosition);
-	}
-
-	s32 numberOfMatches = array_get_length(matches);
-
-	if (numberOfMatches != 2)
+	++result->numberOfCheckedPairs;
+	if (distance > result->maximumDistance)
+		result->maximumDistance = distance;
+	if (distance > epsilon)
 	{
-		printf("Found Odd Pixel: <%d, %d>\n", x, y);
-		printf("Matches:\n");
-		for (s32 i = 0; i < numberOfMatches; ++i)
+		if (result->numberOfMismatches == 0)
 		{
-			DiscreteVec2 match = matches[i];
-			printf("\t<%d, %d>\n", match.x, match.y);
+			result->firstMismatch = (DiscreteVec2){x, y};
+			result->firstMismatchMirror = (DiscreteVec2){mirrorX, mirrorY};
 		}
+		++result->numberOfMismatches;
 	}
-
-	array_release(matches);
 }
 
-// Auxiliar function to detect errors in a spherical geometry image
-extern void gimCheckGeometryImage(const FloatImageData* gimImage)
+// Checks the border symmetry of a spherical geometry image: (0, y) = (0, h - 1 - y), (w - 1, y) = (w - 1, h - 1 - y),
+// (x, 0) = (w - 1 - x, 0), (x, h - 1) = (w - 1 - x, h - 1) and the four corners are the same vertex.
+// Each border pixel is compared only with its mirror, so this is linear in the size of the border.
+// Vertices match when none of their coordinates differ by more than epsilon
+extern GimBorderCheckResult gimCheckGeometryImage(const FloatImageData* gimImage, r32 epsilon)
 {
-	for (s32 i = 0; i < gimImage->height; ++i)
+	GimBorderCheckResult result = {0};
+	s32 w = gimImage->width, h = gimImage->height;
+
+	// Left/right borders
+	for (s32 i = 1; i < h / 2; ++i)
 	{
-		checkNumberOfMatches(gimImage, 0, i);
-		checkNumberOfMatches(gimImage, gimImage->width - 1, i);
+		checkBorderPair(gimImage, 0, i, 0, h - 1 - i, epsilon, &result);
+		checkBorderPair(gimImage, w - 1, i, w - 1, h - 1 - i, epsilon, &result);
 	}
 
-	for (s32 j = 1; j < gimImage->width - 1; ++j)
+	// Top/bottom borders
+	for (s32 j = 1; j < w / 2; ++j)
 	{
-		checkNumberOfMatches(gimImage, j, 0);
-		checkNumberOfMatches(gimImage, j, gimImage->height - 1);
+		checkBorderPair(gimImage, j, 0, w - 1 - j, 0, epsilon, &result);
+		checkBorderPair(gimImage, j, h - 1, w - 1 - j, h - 1, epsilon, &result);
 	}
+
+	// Corners
+	checkBorderPair(gimImage, w - 1, 0, 0, 0, epsilon, &result);
+	checkBorderPair(gimImage, 0, h - 1, 0, 0, epsilon, &result);
+	checkBorderPair(gimImage, w - 1, h - 1, 0, 0, epsilon, &result);
+
+	return result;
 }
 
 extern GeometryImage gimCopyGeometryImage(const GeometryImage* gim, boolean copy3d)
@@ -462,4 +586,115 @@ extern int gimExportToGimFile(const GeometryImage* gim, const s8* filePath)
 	fclose(file);
 
 	return 0;
-}
\ No newline at end of file
+}
+
+// Returns the size of the next (coarser) level of a geometry image pyramid.
+// Sizes are kept odd, so the center row/column, which is its own mirror, still exists in the coarser level (2047 -> 1023 -> 511, 513 -> 257 -> 129)
+extern s32 gimGetDownsampledSize(s32 size)
+{
+	s32 halfSize = (size + 1) / 2;
+	return (halfSize % 2) ? halfSize : halfSize - 1;
+}
+
+// Forces the border of a spherical geometry image to be symmetric: (0, y) = (0, h - 1 - y), (w - 1, y) = (w - 1, h - 1 - y),
+// (x, 0) = (w - 1 - x, 0), (x, h - 1) = (w - 1 - x, h - 1) and the four corners are the same vertex.
+// The first half of each border is taken as reference
+extern void gimEnforceBorderSymmetry(FloatImageData* img)
+{
+	s32 w = img->width, h = img->height, c = img->channels;
+
+	// Left/right borders
+	for (s32 i = 0; i < h / 2; ++i)
+	{
+		s32 mirrorYPosition = h - i - 1;
+		memcpy(&img->data[mirrorYPosition * w * c + 0 * c], &img->data[i * w * c + 0 * c], sizeof(r32) * c);
+		memcpy(&img->data[mirrorYPosition * w * c + (w - 1) * c], &img->data[i * w * c + (w - 1) * c], sizeof(r32) * c);
+	}
+
+	// Top/bottom borders
+	for (s32 j = 0; j < w / 2; ++j)
+	{
+		s32 mirrorXPosition = w - j - 1;
+		memcpy(&img->data[0 * w * c + mirrorXPosition * c], &img->data[0 * w * c + j * c], sizeof(r32) * c);
+		memcpy(&img->data[(h - 1) * w * c + mirrorXPosition * c], &img->data[(h - 1) * w * c + j * c], sizeof(r32) * c);
+	}
+
+	// Corners
+	memcpy(&img->data[0 * w * c + (w - 1) * c], &img->data[0], sizeof(r32) * c);
+	memcpy(&img->data[(h - 1) * w * c + 0 * c], &img->data[0], sizeof(r32) * c);
+	memcpy(&img->data[(h - 1) * w * c + (w - 1) * c], &img->data[0], sizeof(r32) * c);
+}
+
+// Resamples a geometry image to width x height using bilinear interpolation.
+// Borders are mapped to borders, so when (size - 1) is halved exactly this is a plain decimation
+extern FloatImageData gimResampleImage(const FloatImageData* img, s32 width, s32 height)
+{
+	FloatImageData result;
+	s32 c = img->channels;
+	result.width = width;
+	result.height = height;
+	result.channels = c;
+	result.data = malloc(sizeof(r32) * width * height * c);
+
+	r32 xRatio = (r32)(img->width - 1) / (r32)(width - 1);
+	r32 yRatio = (r32)(img->height - 1) / (r32)(height - 1);
+
+	for (s32 i = 0; i < height; ++i)
+	{
+		r32 sourceY = i * yRatio;
+		s32 y0 = (s32)sourceY;
+		if (y0 > img->height - 2) y0 = img->height - 2;
+		r32 fy = sourceY - y0;
+
+		for (s32 j = 0; j < width; ++j)
+		{
+			r32 sourceX = j * xRatio;
+			s32 x0 = (s32)sourceX;
+			if (x0 > img->width - 2) x0 = img->width - 2;
+			r32 fx = sourceX - x0;
+
+			const r32* p00 = &img->data[y0 * img->width * c + x0 * c];
+			const r32* p01 = p00 + c;
+			const r32* p10 = p00 + img->width * c;
+			const r32* p11 = p10 + c;
+			r32* out = &result.data[i * width * c + j * c];
+
+			for (s32 k = 0; k < c; ++k)
+				out[k] = (1.0f - fy) * ((1.0f - fx) * p00[k] + fx * p01[k]) + fy * ((1.0f - fx) * p10[k] + fx * p11[k]);
+		}
+	}
+
+	// Bilinear interpolation of mirrored pixels may differ by rounding errors
+	gimEnforceBorderSymmetry(&result);
+	return result;
+}
+
+// Creates a level-of-detail pyramid of the geometry image. The first level is a copy of img and each
+// following level has the size given by gimGetDownsampledSize, until the size would get below minimumSize.
+// The result is a dynamic array and must be freed with gimFreePyramid
+extern FloatImageData* gimCreatePyramid(const FloatImageData* img, s32 minimumSize)
+{
+	FloatImageData* pyramid = array_create(FloatImageData, 1);
+	FloatImageData level = graphicsFloatImageCopy(img);
+	array_push(pyramid, &level);
+
+	while (true)
+	{
+		const FloatImageData* last = &pyramid[array_get_length(pyramid) - 1];
+		s32 width = gimGetDownsampledSize(last->width);
+		s32 height = gimGetDownsampledSize(last->height);
+		if (width < minimumSize || height < minimumSize)
+			break;
+		level = gimResampleImage(last, width, height);
+		array_push(pyramid, &level);
+	}
+
+	return pyramid;
+}
+
+extern void gimFreePyramid(FloatImageData* pyramid)
+{
+	for (u32 i = 0; i < array_get_length(pyramid); ++i)
+		graphicsFloatImageFree(&pyramid[i]);
+	array_release(pyramid);
+}
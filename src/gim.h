@@ -4,6 +4,7 @@
 #include "dynamic_array.h"
 
 typedef struct GeometryImage GeometryImage;
+typedef struct GimBorderCheckResult GimBorderCheckResult;
 
 struct GeometryImage
 {
@@ -13,17 +14,35 @@ struct GeometryImage
 	Vec4* normals;
 };
 
+// Result of gimCheckGeometryImage. Distances are the largest difference between the coordinates of a border vertex and
+// its mirror
+struct GimBorderCheckResult
+{
+	s32 numberOfCheckedPairs;
+	s32 numberOfMismatches;
+	// First pixel that does not match its mirror. Only valid if numberOfMismatches > 0
+	DiscreteVec2 firstMismatch;
+	DiscreteVec2 firstMismatchMirror;
+	r32 maximumDistance;
+};
+
 extern int gimParseGeometryImageFile(GeometryImage* gim, const u8* path);
 extern void gimGeometryImageUpdate3D(GeometryImage* gim);
+extern void gimEstimateNormals(GeometryImage* gim);
 extern Mesh gimGeometryImageToMesh(const GeometryImage* gim, Vec4 color);
 extern void gimExportToObjFile(const GeometryImage* gim, const s8* objPath);
-extern FloatImageData gimNormalizeImageForVisualization(const FloatImageData* gimImage);
+extern ImageData gimNormalizeImageForVisualization(const FloatImageData* gimImage);
 extern void gimNormalizeAndSave(const GeometryImage* gim, const s8* imagePath);
 extern void gimFreeGeometryImage(GeometryImage* gim);
-extern void gimCheckGeometryImage(const FloatImageData* gimImage);
+extern GimBorderCheckResult gimCheckGeometryImage(const FloatImageData* gimImage, r32 epsilon);
 extern GeometryImage gimCopyGeometryImage(const GeometryImage* gim, boolean copy3d);
-extern GeometryImage gimAddNoise(const GeometryImage* gim, r32 noiseIntensity);
+extern GeometryImage gimAddNoise(const GeometryImage* gim, r32 noiseIntensity, u64 seed);
 extern void gimExportToPointCloudFile(const GeometryImage* gim, const s8* asciiFilePath);
 extern int gimExportToGimFile(const GeometryImage* gim, const s8* filePath);
+extern s32 gimGetDownsampledSize(s32 size);
+extern void gimEnforceBorderSymmetry(FloatImageData* img);
+extern FloatImageData gimResampleImage(const FloatImageData* img, s32 width, s32 height);
+extern FloatImageData* gimCreatePyramid(const FloatImageData* img, s32 minimumSize);
+extern void gimFreePyramid(FloatImageData* pyramid);
 
 #endif
\ No newline at end of file
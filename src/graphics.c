@@ -7,6 +7,9 @@
 #include <stb_image.h>
 #include <stb_image_write.h>
 #include <dynamic_array.h>
+#include <assert.h>
+#include <stddef.h>
+#include <math.h>
 
 extern ImageData graphicsImageLoad(const s8* imagePath)
 {
@@ -154,7 +157,7 @@ extern Mesh graphicsQuadCreateWithTexture(u32 texture)
 	fillQuadVerticesAndIndexes(size, vertices, indices);
 
 	return graphicsMeshCreateWithTexture(vertices, sizeof(vertices) / sizeof(Vertex), indices,
-		sizeof(indices) / sizeof(u32), 0, texture);
+		sizeof(indices) / sizeof(u32), 0, texture, VERTEX_LAYOUT_DEFAULT);
 }
 
 extern Mesh graphicsQuadCreateWithColor(Vec4 color)
@@ -166,10 +169,47 @@ extern Mesh graphicsQuadCreateWithColor(Vec4 color)
 	fillQuadVerticesAndIndexes(size, vertices, indices);
 
 	return graphicsMeshCreateWithColor(vertices, sizeof(vertices) / sizeof(Vertex), indices,
-		sizeof(indices) / sizeof(u32), 0, color);
+		sizeof(indices) / sizeof(u32), 0, color, VERTEX_LAYOUT_DEFAULT);
 }
 
-static Mesh createSimpleMesh(Vertex* vertices, s32 verticesSize, u32* indices, s32 indicesSize, NormalMappingInfo* normalInfo)
+// Maps the normal to the octahedron |x| + |y| + |z| = 1 and unfolds the lower half over the upper half
+static void encodeOctahedralNormal(Vec4 normal, s16 encodedNormal[2])
+{
+	r32 l1Norm = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	r32 x = (l1Norm > 0.0f) ? normal.x / l1Norm : 0.0f;
+	r32 y = (l1Norm > 0.0f) ? normal.y / l1Norm : 0.0f;
+
+	if (normal.z < 0.0f)
+	{
+		r32 unfoldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		r32 unfoldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+
+	encodedNormal[0] = (s16)roundf(x * 32767.0f);
+	encodedNormal[1] = (s16)roundf(y * 32767.0f);
+}
+
+static CompactVertex* createCompactVertices(const Vertex* vertices, s32 verticesSize)
+{
+	CompactVertex* compactVertices = malloc(sizeof(CompactVertex) * verticesSize);
+
+	for (s32 i = 0; i < verticesSize; ++i)
+	{
+		compactVertices[i].position[0] = vertices[i].position.x;
+		compactVertices[i].position[1] = vertices[i].position.y;
+		compactVertices[i].position[2] = vertices[i].position.z;
+		encodeOctahedralNormal(vertices[i].normal, compactVertices[i].normal);
+		compactVertices[i].textureCoordinates[0] = (u16)roundf(vertices[i].textureCoordinates.x * 65535.0f);
+		compactVertices[i].textureCoordinates[1] = (u16)roundf(vertices[i].textureCoordinates.y * 65535.0f);
+	}
+
+	return compactVertices;
+}
+
+static Mesh createSimpleMesh(Vertex* vertices, s32 verticesSize, u32* indices, s32 indicesSize, NormalMappingInfo* normalInfo,
+	VertexLayout vertexLayout)
 {
 	Mesh mesh;
 	GLuint VBO, EBO, VAO;
@@ -180,17 +220,37 @@ static Mesh createSimpleMesh(Vertex* vertices, s32 verticesSize, u32* indices, s
 	glBindVertexArray(VAO);
 
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, verticesSize * sizeof(Vertex), 0, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, verticesSize * sizeof(Vertex), vertices);
 
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 10 * sizeof(GLfloat), (void*)(0 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(0);
+	if (vertexLayout == VERTEX_LAYOUT_COMPACT)
+	{
+		CompactVertex* compactVertices = createCompactVertices(vertices, verticesSize);
+		glBufferData(GL_ARRAY_BUFFER, verticesSize * sizeof(CompactVertex), compactVertices, GL_STATIC_DRAW);
+		free(compactVertices);
+
+		// Missing components are filled by GL: position gets w = 1
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+		glEnableVertexAttribArray(0);
+
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+		glEnableVertexAttribArray(1);
+
+		glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, textureCoordinates));
+		glEnableVertexAttribArray(2);
+	}
+	else
+	{
+		glBufferData(GL_ARRAY_BUFFER, verticesSize * sizeof(Vertex), 0, GL_STATIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, verticesSize * sizeof(Vertex), vertices);
 
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 10 * sizeof(GLfloat), (void*)(4 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 10 * sizeof(GLfloat), (void*)(0 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(0);
 
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 10 * sizeof(GLfloat), (void*)(8 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(2);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 10 * sizeof(GLfloat), (void*)(4 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(1);
+
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 10 * sizeof(GLfloat), (void*)(8 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(2);
+	}
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesSize * sizeof(u32), 0, GL_STATIC_DRAW);
@@ -205,6 +265,11 @@ static Mesh createSimpleMesh(Vertex* vertices, s32 verticesSize, u32* indices, s
 	mesh.VBO = VBO;
 	mesh.EBO = EBO;
 	mesh.indexesSize = indicesSize;
+	mesh.vertexLayout = vertexLayout;
+	mesh.gimInfo.useGeometryImage = false;
+	mesh.gimInfo.positionsTexture = 0;
+	mesh.gimInfo.width = 0;
+	mesh.gimInfo.height = 0;
 
 	if (!normalInfo)
 	{
@@ -218,22 +283,134 @@ static Mesh createSimpleMesh(Vertex* vertices, s32 verticesSize, u32* indices, s
 	return mesh;
 }
 
-extern Mesh graphicsMeshCreateWithColor(Vertex* vertices, s32 verticesSize, u32* indices, s32 indicesSize, NormalMappingInfo* normalInfo, Vec4 diffuseColor)
+extern Mesh graphicsMeshCreateWithColor(Vertex* vertices, s32 verticesSize, u32* indices, s32 indicesSize, NormalMappingInfo* normalInfo, Vec4 diffuseColor,
+	VertexLayout vertexLayout)
 {
-	Mesh mesh = createSimpleMesh(vertices, verticesSize, indices, indicesSize, normalInfo);
+	Mesh mesh = createSimpleMesh(vertices, verticesSize, indices, indicesSize, normalInfo, vertexLayout);
 	mesh.diffuseInfo.useDiffuseMap = false;
 	mesh.diffuseInfo.diffuseColor = diffuseColor;
 	return mesh;
 }
 
-extern Mesh graphicsMeshCreateWithTexture(Vertex* vertices, s32 verticesSize, u32* indices, s32 indicesSize, NormalMappingInfo* normalInfo, u32 diffuseMap)
+extern Mesh graphicsMeshCreateWithTexture(Vertex* vertices, s32 verticesSize, u32* indices, s32 indicesSize, NormalMappingInfo* normalInfo, u32 diffuseMap,
+	VertexLayout vertexLayout)
 {
-	Mesh mesh = createSimpleMesh(vertices, verticesSize, indices, indicesSize, normalInfo);
+	Mesh mesh = createSimpleMesh(vertices, verticesSize, indices, indicesSize, normalInfo, vertexLayout);
 	mesh.diffuseInfo.useDiffuseMap = true;
 	mesh.diffuseInfo.diffuseMap = diffuseMap;
 	return mesh;
 }
 
+typedef struct
+{
+	s32 width, height;
+	u32 EBO;
+	s32 indexesSize;
+} GridIndexBuffer;
+
+// Grid index buffers are shared by all geometry image meshes of the same size and live until the program ends
+static GridIndexBuffer* gridIndexBuffers;
+
+static GridIndexBuffer getGridIndexBuffer(s32 width, s32 height)
+{
+	if (!gridIndexBuffers)
+		gridIndexBuffers = array_create(GridIndexBuffer, 1);
+
+	for (s32 i = 0; i < array_get_length(gridIndexBuffers); ++i)
+		if (gridIndexBuffers[i].width == width && gridIndexBuffers[i].height == height)
+			return gridIndexBuffers[i];
+
+	GridIndexBuffer gridIndexBuffer;
+	gridIndexBuffer.width = width;
+	gridIndexBuffer.height = height;
+	gridIndexBuffer.indexesSize = (width - 1) * (height - 1) * 6;
+
+	// Each index is the pixel position (y * width + x), the vertex shader recovers the pixel from gl_VertexID
+	u32* indices = malloc(sizeof(u32) * gridIndexBuffer.indexesSize);
+	s32 n = 0;
+	for (s32 i = 0; i < height - 1; ++i)
+		for (s32 j = 0; j < width - 1; ++j)
+		{
+			u32 bottomLeftVertexIndex = i * width + j;
+			u32 topLeftVertexIndex = (i + 1) * width + j;
+			u32 bottomRightVertexIndex = i * width + (j + 1);
+			u32 topRightVertexIndex = (i + 1) * width + (j + 1);
+
+			indices[n++] = bottomLeftVertexIndex;
+			indices[n++] = topRightVertexIndex;
+			indices[n++] = topLeftVertexIndex;
+
+			indices[n++] = bottomLeftVertexIndex;
+			indices[n++] = bottomRightVertexIndex;
+			indices[n++] = topRightVertexIndex;
+		}
+
+	glGenBuffers(1, &gridIndexBuffer.EBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gridIndexBuffer.EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, gridIndexBuffer.indexesSize * sizeof(u32), indices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	free(indices);
+
+	array_push(gridIndexBuffers, &gridIndexBuffer);
+	return gridIndexBuffer;
+}
+
+extern Mesh graphicsMeshCreateFromGeometryImageWithColor(const FloatImageData* positions, Vec4 diffuseColor)
+{
+	Mesh mesh;
+	GLuint VAO;
+	GridIndexBuffer gridIndexBuffer = getGridIndexBuffer(positions->width, positions->height);
+
+	// No vertex attributes are needed, the VAO only holds the element buffer binding
+	glGenVertexArrays(1, &VAO);
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gridIndexBuffer.EBO);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	mesh.VAO = VAO;
+	mesh.VBO = 0;
+	mesh.EBO = gridIndexBuffer.EBO;
+	mesh.indexesSize = gridIndexBuffer.indexesSize;
+	mesh.vertexLayout = VERTEX_LAYOUT_DEFAULT;
+	mesh.normalInfo.tangentSpace = false;
+	mesh.normalInfo.useNormalMap = false;
+	mesh.normalInfo.normalMapTexture = 0;
+	mesh.diffuseInfo.useDiffuseMap = false;
+	mesh.diffuseInfo.diffuseColor = diffuseColor;
+	mesh.gimInfo.useGeometryImage = true;
+	mesh.gimInfo.positionsTexture = graphicsTextureCreateFromFloatData(positions);
+	mesh.gimInfo.width = positions->width;
+	mesh.gimInfo.height = positions->height;
+	return mesh;
+}
+
+extern void graphicsMeshUpdateGeometryImage(Mesh* mesh, const FloatImageData* positions)
+{
+	assert(mesh->gimInfo.useGeometryImage);
+	assert(mesh->gimInfo.width == positions->width && mesh->gimInfo.height == positions->height);
+
+	GLenum format = (positions->channels == 4) ? GL_RGBA : GL_RGB;
+	glBindTexture(GL_TEXTURE_2D, mesh->gimInfo.positionsTexture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, positions->width, positions->height, format, GL_FLOAT, positions->data);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+extern void graphicsMeshUpdateGeometryImageRegion(Mesh* mesh, const FloatImageData* positions, s32 x, s32 y, s32 width, s32 height)
+{
+	assert(mesh->gimInfo.useGeometryImage);
+	assert(mesh->gimInfo.width == positions->width && mesh->gimInfo.height == positions->height);
+	assert(x >= 0 && y >= 0 && x + width <= positions->width && y + height <= positions->height);
+
+	GLenum format = (positions->channels == 4) ? GL_RGBA : GL_RGB;
+	glBindTexture(GL_TEXTURE_2D, mesh->gimInfo.positionsTexture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, positions->width);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, format, GL_FLOAT,
+		&positions->data[y * positions->width * positions->channels + x * positions->channels]);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 static s8* buildLightUniformName(s8* buffer, s32 index, const s8* property)
 {
 	sprintf(buffer, "lights[%d].%s", index, property);
@@ -297,6 +474,25 @@ static void normalsUpdateUniforms(const NormalMappingInfo* normalInfo, Shader sh
 	}
 }
 
+static void vertexLayoutUpdateUniforms(VertexLayout vertexLayout, Shader shader)
+{
+	glUseProgram(shader);
+	GLint octahedralNormalsLocation = glGetUniformLocation(shader, "octahedralNormals");
+	glUniform1i(octahedralNormalsLocation, vertexLayout == VERTEX_LAYOUT_COMPACT);
+}
+
+static void geometryImageUpdateUniforms(const GeometryImageInfo* gimInfo, Shader shader)
+{
+	glUseProgram(shader);
+	if (gimInfo->useGeometryImage)
+	{
+		GLint gimPositionsLocation = glGetUniformLocation(shader, "gimPositions");
+		glUniform1i(gimPositionsLocation, 1);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, gimInfo->positionsTexture);
+	}
+}
+
 // This function must be re-done.
 // This implementation is just temporary, but it's not bug-free and will work only for a limited set of objs.
 extern void graphicsMeshRender(Shader shader, Mesh mesh)
@@ -305,6 +501,8 @@ extern void graphicsMeshRender(Shader shader, Mesh mesh)
 	glUseProgram(shader);
 	diffuseUpdateUniforms(&mesh.diffuseInfo, shader);
 	normalsUpdateUniforms(&mesh.normalInfo, shader);
+	geometryImageUpdateUniforms(&mesh.gimInfo, shader);
+	vertexLayoutUpdateUniforms(mesh.vertexLayout, shader);
 	glDrawElements(GL_TRIANGLES, mesh.indexesSize, GL_UNSIGNED_INT, 0);
 	glUseProgram(0);
 	glBindVertexArray(0);
@@ -389,17 +587,29 @@ extern void graphicsEntityCreate(Entity* entity, Mesh mesh, Vec4 worldPosition,
 	recalculateModelMatrix(entity);
 }
 
+extern void graphicsMeshDelete(Mesh* mesh, boolean deleteNormalMap, boolean deleteDiffuseMap)
+{
+	if (mesh->gimInfo.useGeometryImage)
+	{
+		// The grid index buffer is shared, so only the positions texture is owned by the mesh
+		glDeleteTextures(1, &mesh->gimInfo.positionsTexture);
+	}
+	else
+	{
+		glDeleteBuffers(1, &mesh->VBO);
+		glDeleteBuffers(1, &mesh->EBO);
+	}
+	glDeleteVertexArrays(1, &mesh->VAO);
+	if (deleteNormalMap && mesh->normalInfo.useNormalMap)
+		glDeleteTextures(1, &mesh->normalInfo.normalMapTexture);
+	if (deleteDiffuseMap && mesh->diffuseInfo.useDiffuseMap)
+		glDeleteTextures(1, &mesh->diffuseInfo.diffuseMap);
+}
+
 extern void graphicsEntityMeshReplace(Entity* entity, Mesh mesh,
 	boolean deleteNormalMap , boolean deleteDiffuseMap)
 {
-	glDeleteBuffers(1, &entity->mesh.VBO);
-	glDeleteBuffers(1, &entity->mesh.EBO);
-	glDeleteVertexArrays(1, &entity->mesh.VAO);
-	if (deleteNormalMap && entity->mesh.normalInfo.useNormalMap)
-		glDeleteTextures(1, &entity->mesh.normalInfo.normalMapTexture);
-	if (deleteDiffuseMap && entity->mesh.diffuseInfo.useDiffuseMap)
-		glDeleteTextures(1, &entity->mesh.diffuseInfo.diffuseMap);
-
+	graphicsMeshDelete(&entity->mesh, deleteNormalMap, deleteDiffuseMap);
 	entity->mesh = mesh;
 }
 
@@ -481,6 +691,9 @@ extern u32 graphicsTextureCreateFromData(const ImageData* imageData)
 	return textureId;
 }
 
+// Creates a texture that stores the values of imageData as they are, e.g. the positions of a geometry image.
+// Its texels are read with texelFetch, so it has a single level and no filtering: mipmaps would never be read and would
+// get stale after each update with glTexSubImage2D
 extern u32 graphicsTextureCreateFromFloatData(const FloatImageData* imageData)
 {
 	u32 textureId;
@@ -491,18 +704,12 @@ extern u32 graphicsTextureCreateFromFloatData(const FloatImageData* imageData)
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, imageData->width, imageData->height, 0, GL_RGBA, GL_FLOAT, imageData->data);
 	else
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, imageData->width, imageData->height, 0, GL_RGB, GL_FLOAT, imageData->data);
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-
-	// Anisotropic Filtering
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 4.0f);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
 
 	glBindTexture(GL_TEXTURE_2D, 0);
 
@@ -5,6 +5,7 @@
 
 typedef u32 Shader;
 typedef struct VertexStruct Vertex;
+typedef struct CompactVertexStruct CompactVertex;
 typedef struct NormalMappingInfoStruct NormalMappingInfo;
 typedef struct MeshStruct Mesh;
 typedef struct EntityStruct Entity;
@@ -12,6 +13,7 @@ typedef struct LightStruct Light;
 typedef struct ImageDataStruct ImageData;
 typedef struct FloatImageDataStruct FloatImageData;
 typedef struct DiffuseInfoStruct DiffuseInfo;
+typedef struct GeometryImageInfoStruct GeometryImageInfo;
 
 #pragma pack(push, 1)
 struct VertexStruct
@@ -22,6 +24,25 @@ struct VertexStruct
 };
 #pragma pack(pop)
 
+// GPU-only vertex layout: position w is always 1, normal is octahedral-encoded and
+// texture coordinates are normalized 16-bit integers.
+#pragma pack(push, 1)
+struct CompactVertexStruct
+{
+	r32 position[3];
+	s16 normal[2];
+	u16 textureCoordinates[2];
+};
+#pragma pack(pop)
+
+// Tells how the vertices are stored in the VBO. The CPU side always uses Vertex.
+enum VertexLayoutEnum
+{
+	VERTEX_LAYOUT_DEFAULT = 0,		// Vertex (40 bytes)
+	VERTEX_LAYOUT_COMPACT = 1,		// CompactVertex (20 bytes)
+};
+typedef enum VertexLayoutEnum VertexLayout;
+
 struct NormalMappingInfoStruct
 {
 	boolean useNormalMap;
@@ -36,12 +57,24 @@ struct DiffuseInfoStruct
 	Vec4 diffuseColor;
 };
 
+// When useGeometryImage is set, the mesh has no VBO: vertices are generated in the vertex shader by fetching
+// positionsTexture (a RGB32F texture holding the geometry image) and the EBO is a grid index buffer shared by all
+// geometry image meshes with the same size.
+struct GeometryImageInfoStruct
+{
+	boolean useGeometryImage;
+	u32 positionsTexture;
+	s32 width, height;
+};
+
 struct MeshStruct
 {
 	u32 VAO, VBO, EBO;
 	s32 indexesSize;
+	VertexLayout vertexLayout;
 	NormalMappingInfo normalInfo;
 	DiffuseInfo diffuseInfo;
+	GeometryImageInfo gimInfo;
 };
 
 struct EntityStruct
@@ -83,9 +116,18 @@ extern void graphicsFloatImageSave(const s8* imagePath, const FloatImageData* im
 extern Shader graphicsShaderCreate(const s8* vertexShaderPath, const s8* fragmentShaderPath);
 extern Mesh graphicsQuadCreateWithTexture(u32 texture);
 extern Mesh graphicsQuadCreateWithColor(Vec4 color);
-extern Mesh graphicsMeshCreateWithColor(Vertex* vertices, s32 verticesSize, u32* indices, s32 indicesSize, NormalMappingInfo* normalInfo, Vec4 diffuseColor);
-extern Mesh graphicsMeshCreateWithTexture(Vertex* vertices, s32 verticesSize, u32* indices, s32 indicesSize, NormalMappingInfo* normalInfo, u32 diffuseMap);
+extern Mesh graphicsMeshCreateWithColor(Vertex* vertices, s32 verticesSize, u32* indices, s32 indicesSize, NormalMappingInfo* normalInfo, Vec4 diffuseColor, VertexLayout vertexLayout);
+extern Mesh graphicsMeshCreateWithTexture(Vertex* vertices, s32 verticesSize, u32* indices, s32 indicesSize, NormalMappingInfo* normalInfo, u32 diffuseMap, VertexLayout vertexLayout);
+// Creates a mesh that must be rendered with a geometry image vertex shader (see shaders/gim_phong_shader.vs).
+// Only the positions are uploaded, as a RGB32F texture. Normals and texture coordinates are computed in the shader.
+extern Mesh graphicsMeshCreateFromGeometryImageWithColor(const FloatImageData* positions, Vec4 diffuseColor);
+// Re-uploads the positions of a mesh created by graphicsMeshCreateFromGeometryImageWithColor.
+// positions must have the same size as the image used to create the mesh.
+extern void graphicsMeshUpdateGeometryImage(Mesh* mesh, const FloatImageData* positions);
+// Same as graphicsMeshUpdateGeometryImage, but only the rectangle <x, y, width, height> is uploaded
+extern void graphicsMeshUpdateGeometryImageRegion(Mesh* mesh, const FloatImageData* positions, s32 x, s32 y, s32 width, s32 height);
 extern void graphicsMeshRender(Shader shader, Mesh mesh);
+extern void graphicsMeshDelete(Mesh* mesh, boolean deleteNormalMap, boolean deleteDiffuseMap);
 // If mesh already has a diffuse map, the older diffuse map will be deleted if deleteDiffuseMap is true.
 // If mesh has a color instead of a diffuse map, the mesh will lose the color and be set to use the diffuse map.
 extern void graphicsMeshChangeDiffuseMap(Mesh* mesh, u32 diffuseMap, boolean deleteDiffuseMap);
@@ -2,264 +2,259 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-typedef struct
-{
-	int valid;
-} Hash_Map_Element_Information;
+// Control bytes of the slots that have no key. Full slots store the lower 7 bits of the hash, so their high bit is clear
+#define CONTROL_EMPTY 0x80
+#define CONTROL_DELETED 0xFE
 
-static Hash_Map_Element_Information *get_element_information(Hash_Map *hm, unsigned int index)
+// MurmurHash3 finalizer: every bit of the key affects every bit of the hash
+static inline u64 hash_key(u64 key)
 {
-	return (Hash_Map_Element_Information *)((unsigned char *)hm->data +
-											index * (sizeof(Hash_Map_Element_Information) + hm->key_size + hm->value_size));
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
 }
 
-static void *get_element_key(Hash_Map *hm, unsigned int index)
+// Maximum number of full and deleted slots before the table must grow (load factor of 7/8)
+static inline u32 get_max_load(u32 capacity)
 {
-	Hash_Map_Element_Information *hmei = get_element_information(hm, index);
-	return (unsigned char *)hmei + sizeof(Hash_Map_Element_Information);
+	return capacity - capacity / 8;
 }
 
-static void *get_element_value(Hash_Map *hm, unsigned int index)
+static u32 get_capacity_for(u32 num_elements)
 {
-	Hash_Map_Element_Information *hmei = get_element_information(hm, index);
-	return (unsigned char *)hmei + sizeof(Hash_Map_Element_Information) + hm->key_size;
+	u32 capacity = HASH_MAP_GROUP_WIDTH;
+	while (get_max_load(capacity) < num_elements)
+		capacity <<= 1;
+	return capacity;
 }
 
-static void put_element_key(Hash_Map *hm, unsigned int index, const void *key)
+// Bit i of the result is set when the control byte i of the group equals 'value'
+static inline u32 group_match(const u8* group, u8 value)
 {
-	void *target = get_element_key(hm, index);
-	memcpy(target, key, hm->key_size);
+#if defined(__SSE2__)
+	__m128i control = _mm_loadu_si128((const __m128i*)group);
+	return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8((char)value)));
+#else
+	u32 mask = 0;
+	for (u32 i = 0; i < HASH_MAP_GROUP_WIDTH; ++i)
+		if (group[i] == value)
+			mask |= 1u << i;
+	return mask;
+#endif
 }
 
-static void put_element_value(Hash_Map *hm, unsigned int index, const void *value)
+// Bit i of the result is set when the slot i of the group is empty or deleted
+static inline u32 group_match_free(const u8* group)
 {
-	void *target = get_element_value(hm, index);
-	memcpy(target, value, hm->value_size);
+#if defined(__SSE2__)
+	return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)group));
+#else
+	u32 mask = 0;
+	for (u32 i = 0; i < HASH_MAP_GROUP_WIDTH; ++i)
+		if (group[i] & 0x80)
+			mask |= 1u << i;
+	return mask;
+#endif
 }
 
-int hash_map_create(Hash_Map *hm, unsigned int initial_capacity, size_t key_size, size_t value_size,
-					KeyCompareFunc key_compare_func, KeyHashFunc key_hash_func)
+static void set_control(Hash_Map* hm, u32 index, u8 value)
 {
-	hm->key_compare_func = key_compare_func;
-	hm->key_hash_func = key_hash_func;
-	hm->key_size = key_size;
-	hm->value_size = value_size;
-	hm->capacity = initial_capacity > 0 ? initial_capacity : 1;
-	hm->num_elements = 0;
-	hm->data = calloc(hm->capacity, sizeof(Hash_Map_Element_Information) + key_size + value_size);
-	if (!hm->data)
-	{
-		printf("Error: not enough memory to allocate hash map.");
-		return -1;
-	}
-	return 0;
+	hm->control[index] = value;
+	// The first group is repeated after the last slot
+	if (index < HASH_MAP_GROUP_WIDTH)
+		hm->control[hm->capacity + index] = value;
 }
 
-void hash_map_destroy(Hash_Map *hm)
+// Groups are probed at increasing distances (triangular probing), which visits every group when capacity is a power of two
+static int find_slot(const Hash_Map* hm, u64 key, u64 hash, u32* slot)
 {
-	free(hm->data);
-}
+	u32 mask = hm->capacity - 1;
+	u8 h2 = (u8)(hash & 0x7F);
+	u32 pos = (u32)(hash >> 7) & mask;
 
-static int hash_map_grow(Hash_Map *hm)
-{
-	Hash_Map old_hm = *hm;
-	if (hash_map_create(hm, old_hm.capacity << 1, old_hm.key_size, old_hm.value_size, old_hm.key_compare_func, old_hm.key_hash_func))
+	for (u32 step = HASH_MAP_GROUP_WIDTH;; step += HASH_MAP_GROUP_WIDTH)
 	{
-		printf("Error when growing hash map: could not create new hash map");
-		return -1;
-	}
-
-	for (unsigned int pos = 0; pos < old_hm.capacity; ++pos)
-	{
-		Hash_Map_Element_Information *hmei = get_element_information(&old_hm, pos);
-		if (hmei->valid)
+		const u8* group = &hm->control[pos];
+		for (u32 match = group_match(group, h2); match; match &= match - 1)
 		{
-			void *key = get_element_key(&old_hm, pos);
-			void *value = get_element_value(&old_hm, pos);
-			if (hash_map_put(hm, key, value))
+			u32 index = (pos + __builtin_ctz(match)) & mask;
+			if (hm->keys[index] == key)
 			{
-				printf("Error when growing hash map: could not put element");
-				return -1;
+				*slot = index;
+				return 0;
 			}
 		}
-	}
 
-	hash_map_destroy(&old_hm);
-	return 0;
+		// The key would have been inserted in the empty slot
+		if (group_match(group, CONTROL_EMPTY))
+			return -1;
+
+		pos = (pos + step) & mask;
+	}
 }
 
-int hash_map_put(Hash_Map *hm, const void *key, const void *value)
+static u32 find_free_slot(const Hash_Map* hm, u64 hash)
 {
-	unsigned int pos = hm->key_hash_func(key) % hm->capacity;
+	u32 mask = hm->capacity - 1;
+	u32 pos = (u32)(hash >> 7) & mask;
 
-	for (;;)
+	for (u32 step = HASH_MAP_GROUP_WIDTH;; step += HASH_MAP_GROUP_WIDTH)
 	{
-		Hash_Map_Element_Information *hmei = get_element_information(hm, pos);
-		if (!hmei->valid)
-		{
-			hmei->valid = 1;
-			put_element_key(hm, pos, key);
-			put_element_value(hm, pos, value);
-			++hm->num_elements;
-			break;
-		}
-		else
-		{
-			void *element_key = get_element_key(hm, pos);
-			if (hm->key_compare_func(element_key, key))
-			{
-				put_element_key(hm, pos, key);
-				put_element_value(hm, pos, value);
-				break;
-			}
-		}
-
-		pos = (pos + 1) % hm->capacity;
+		u32 match = group_match_free(&hm->control[pos]);
+		if (match)
+			return (pos + __builtin_ctz(match)) & mask;
+		pos = (pos + step) & mask;
 	}
+}
+
+// Inserts a key that is not in the hash map. There must be room for it
+static void insert_new(Hash_Map* hm, u64 key, u32 value, u64 hash)
+{
+	u32 slot = find_free_slot(hm, hash);
+	if (hm->control[slot] == CONTROL_DELETED)
+		--hm->num_deleted;
+
+	set_control(hm, slot, (u8)(hash & 0x7F));
+	hm->keys[slot] = key;
+	hm->values[slot] = value;
+	++hm->num_elements;
+}
 
-	if ((hm->num_elements << 2) > hm->capacity)
+static int allocate_table(Hash_Map* hm, u32 capacity)
+{
+	hm->capacity = capacity;
+	hm->num_elements = 0;
+	hm->num_deleted = 0;
+	hm->control = malloc(capacity + HASH_MAP_GROUP_WIDTH);
+	hm->keys = malloc(sizeof(u64) * capacity);
+	hm->values = malloc(sizeof(u32) * capacity);
+	if (!hm->control || !hm->keys || !hm->values)
 	{
-		if (hash_map_grow(hm))
-		{
-			return -1;
-		}
+		printf("Error: not enough memory to allocate hash map.");
+		free(hm->control);
+		free(hm->keys);
+		free(hm->values);
+		return -1;
 	}
 
+	memset(hm->control, CONTROL_EMPTY, capacity + HASH_MAP_GROUP_WIDTH);
 	return 0;
 }
 
-int hash_map_get(Hash_Map *hm, const void *key, void *value)
+// Moves all elements to a new table. Deleted slots are dropped. Keys are known to be unique, so they are not compared
+static int rehash(Hash_Map* hm, u32 capacity)
 {
-	unsigned int pos = hm->key_hash_func(key) % hm->capacity;
-	for (;;)
+	Hash_Map old_hm = *hm;
+	if (allocate_table(hm, capacity))
 	{
-		Hash_Map_Element_Information *hmei = get_element_information(hm, pos);
-		if (hmei->valid)
-		{
-			void *possible_key = get_element_key(hm, pos);
-			if (hm->key_compare_func(possible_key, key))
-			{
-				void *entry_value = get_element_value(hm, pos);
-				memcpy(value, entry_value, hm->value_size);
-				return 0;
-			}
-		}
-		else
-		{
-			return -1;
-		}
-
-		pos = (pos + 1) % hm->capacity;
+		*hm = old_hm;
+		return -1;
 	}
+
+	for (u32 pos = 0; pos < old_hm.capacity; ++pos)
+		if (!(old_hm.control[pos] & 0x80))
+			insert_new(hm, old_hm.keys[pos], old_hm.values[pos], hash_key(old_hm.keys[pos]));
+
+	hash_map_destroy(&old_hm);
+	return 0;
 }
 
-static void adjust_gap(Hash_Map *hm, unsigned int gap_index)
+int hash_map_create(Hash_Map* hm, u32 initial_capacity)
 {
-	unsigned int pos = (gap_index + 1) % hm->capacity;
-	for (;;)
-	{
-		Hash_Map_Element_Information *current_hmei = get_element_information(hm, pos);
-		if (!current_hmei->valid)
-		{
-			break;
-		}
+	return allocate_table(hm, get_capacity_for(initial_capacity));
+}
 
-		void *current_key = get_element_key(hm, pos);
-		unsigned int hash_position = hm->key_hash_func(current_key) % hm->capacity;
-		unsigned int normalized_gap_index = (gap_index < hash_position) ? gap_index + hm->capacity : gap_index;
-		unsigned int normalized_pos = (pos < hash_position) ? pos + hm->capacity : pos;
-		if (normalized_gap_index >= hash_position && normalized_gap_index <= normalized_pos)
-		{
-			void *current_value = get_element_value(hm, pos);
-			current_hmei->valid = 0;
-
-			Hash_Map_Element_Information *gap_hmei = get_element_information(hm, gap_index);
-			put_element_key(hm, gap_index, current_key);
-			put_element_value(hm, gap_index, current_value);
-			gap_hmei->valid = 1;
-			gap_index = pos;
-		}
-		pos = (pos + 1) % hm->capacity;
-	}
+void hash_map_destroy(Hash_Map* hm)
+{
+	free(hm->control);
+	free(hm->keys);
+	free(hm->values);
 }
 
-int hash_map_delete(Hash_Map *hm, const void *key)
+// Makes room for num_elements elements, so they can be put without growing the table
+int hash_map_reserve(Hash_Map* hm, u32 num_elements)
 {
-	unsigned int pos = hm->key_hash_func(key) % hm->capacity;
-	for (;;)
+	if (num_elements + hm->num_deleted <= get_max_load(hm->capacity))
+		return 0;
+	return rehash(hm, get_capacity_for(num_elements));
+}
+
+int hash_map_put(Hash_Map* hm, u64 key, u32 value)
+{
+	u64 hash = hash_key(key);
+	u32 slot;
+
+	if (find_slot(hm, key, hash, &slot) == 0)
 	{
-		Hash_Map_Element_Information *hmei = get_element_information(hm, pos);
-		if (hmei->valid)
-		{
-			void *possible_key = get_element_key(hm, pos);
-			if (hm->key_compare_func(possible_key, key))
-			{
-				hmei->valid = 0;
-				adjust_gap(hm, pos);
-				--hm->num_elements;
-				return 0;
-			}
-		}
-		else
+		hm->values[slot] = value;
+		return 0;
+	}
+
+	if (hm->num_elements + hm->num_deleted + 1 > get_max_load(hm->capacity))
+		if (rehash(hm, get_capacity_for(hm->num_elements + 1)))
 		{
+			printf("Error when growing hash map: could not create new hash map");
 			return -1;
 		}
 
-		pos = (pos + 1) % hm->capacity;
-	}
+	insert_new(hm, key, value, hash);
+	return 0;
 }
 
-char buffer[1 * 1024 * 1024];
-#include <assert.h>
-void hash_map_log(Hash_Map *hm)
+// Puts 'count' elements. The table grows at most once, before any element is put
+int hash_map_put_bulk(Hash_Map* hm, const u64* keys, const u32* values, u32 count)
 {
-	static int flag = 0;
-	assert(flag == 0);
-	flag = 1;
-	int written = 0;
-	written += sprintf(buffer, "\n\nhashmap size: %d\nhashmap ptr: %p\n", hm->capacity, hm->data);
-	for (unsigned int pos = 0; pos < hm->capacity; ++pos)
+	if (hash_map_reserve(hm, hm->num_elements + count))
 	{
-		Hash_Map_Element_Information *hmei = get_element_information(hm, pos);
-		if (hmei->valid)
-		{
-			void *key = get_element_key(hm, pos);
-			void *value = get_element_value(hm, pos);
-			written += sprintf(buffer + written, "%u. %d -> %p\n", pos, *(int *)key, *(void **)value);
-		}
+		printf("Error when growing hash map: could not create new hash map");
+		return -1;
 	}
 
-	written += sprintf(buffer + written, "the end of this hash map");
-	buffer[written] = 0;
-	printf("%s", buffer);
-	flag = 0;
-
-	#if 0
-	printf("HashMap Size: %d", hm->capacity);
-	for (unsigned int pos = 0; pos < hm->capacity; ++pos)
+	for (u32 i = 0; i < count; ++i)
 	{
-		Hash_Map_Element_Information *hmei = get_element_information(hm, pos);
-		if (hmei->valid)
-		{
-			void *key = get_element_key(hm, pos);
-			void *value = get_element_value(hm, pos);
-			printf("%u. %d -> %p", pos, *(int *)key, *(void **)value);
-		}
+		u64 hash = hash_key(keys[i]);
+		u32 slot;
+		if (find_slot(hm, keys[i], hash, &slot) == 0)
+			hm->values[slot] = values[i];
+		else
+			insert_new(hm, keys[i], values[i], hash);
 	}
-	#endif
+
+	return 0;
 }
 
-void hash_map_for_each_entry(Hash_Map *hm, ForEachFunc for_each_func, void *custom_data)
+int hash_map_get(const Hash_Map* hm, u64 key, u32* value)
 {
-	for (unsigned int pos = 0; pos < hm->capacity; ++pos)
-	{
-		Hash_Map_Element_Information *hmei = get_element_information(hm, pos);
-		if (hmei->valid)
-		{
-			void *key = get_element_key(hm, pos);
-			void *value = get_element_value(hm, pos);
-			for_each_func(key, value, custom_data);
-		}
-	}
-}
\ No newline at end of file
+	u32 slot;
+	if (find_slot(hm, key, hash_key(key), &slot))
+		return -1;
+
+	*value = hm->values[slot];
+	return 0;
+}
+
+int hash_map_delete(Hash_Map* hm, u64 key)
+{
+	u32 slot;
+	if (find_slot(hm, key, hash_key(key), &slot))
+		return -1;
+
+	set_control(hm, slot, CONTROL_DELETED);
+	--hm->num_elements;
+	++hm->num_deleted;
+	return 0;
+}
+
+void hash_map_for_each_entry(const Hash_Map* hm, ForEachFunc for_each_func, void* custom_data)
+{
+	for (u32 pos = 0; pos < hm->capacity; ++pos)
+		if (!(hm->control[pos] & 0x80))
+			for_each_func(hm->keys[pos], hm->values[pos], custom_data);
+}
@@ -1,32 +1,38 @@
-#ifndef SAP_FUSE_WEBHDFS_HASH_MAP_H
-#define SAP_FUSE_WEBHDFS_HASH_MAP_H
-#include <stddef.h>
+#ifndef GIMMESH_HASH_MAP_H
+#define GIMMESH_HASH_MAP_H
+#include "common.h"
 
-typedef int (*KeyCompareFunc)(const void *key1, const void *key2);
-typedef unsigned int (*KeyHashFunc)(const void *key);
-typedef void (*ForEachFunc)(const void *key, const void* value, void* custom_data);
+// Number of control bytes checked together when probing
+#define HASH_MAP_GROUP_WIDTH 16
 
+typedef void (*ForEachFunc)(u64 key, u32 value, void* custom_data);
+
+// Open addressing hash map from u64 keys to u32 values (Swiss table layout).
+// Each slot has a control byte, kept in a separate array, that tells whether the slot is empty, deleted or full, and in
+// the latter case stores 7 bits of the hash of its key. A probe compares a whole group of control bytes at once and only
+// reads the keys whose control byte matches.
 typedef struct
 {
-	unsigned int capacity;
-	unsigned int num_elements;
-	size_t key_size;
-	size_t value_size;
-	KeyCompareFunc key_compare_func;
-	KeyHashFunc key_hash_func;
-	void *data;
+	// capacity + HASH_MAP_GROUP_WIDTH bytes. The last group repeats the first one, so a group can start at any slot
+	u8* control;
+	u64* keys;
+	u32* values;
+	// Always a power of two, not smaller than HASH_MAP_GROUP_WIDTH
+	u32 capacity;
+	u32 num_elements;
+	u32 num_deleted;
 } Hash_Map;
 
-int hash_map_create(Hash_Map *hm, unsigned int initial_capacity, size_t key_size, size_t value_size,
-					KeyCompareFunc key_compare_func, KeyHashFunc key_hash_func);
-int hash_map_put(Hash_Map *hm, const void *key, const void *value);
-int hash_map_get(Hash_Map *hm, const void *key, void *value);
-int hash_map_delete(Hash_Map *hm, const void *key);
-void hash_map_destroy(Hash_Map *hm);
-void hash_map_log(Hash_Map *hm);
+int hash_map_create(Hash_Map* hm, u32 initial_capacity);
+int hash_map_reserve(Hash_Map* hm, u32 num_elements);
+int hash_map_put(Hash_Map* hm, u64 key, u32 value);
+int hash_map_put_bulk(Hash_Map* hm, const u64* keys, const u32* values, u32 count);
+int hash_map_get(const Hash_Map* hm, u64 key, u32* value);
+int hash_map_delete(Hash_Map* hm, u64 key);
+void hash_map_destroy(Hash_Map* hm);
 
 // @NOTE: Do not put or delete elements in the for_each_func. Putting/deleting elements might alter the hash table internal
 // data structure, which will cause unexpected behavior in this function.
-void hash_map_for_each_entry(Hash_Map *hm, ForEachFunc for_each_func, void *custom_data);
+void hash_map_for_each_entry(const Hash_Map* hm, ForEachFunc for_each_func, void* custom_data);
 
-#endif
\ No newline at end of file
+#endif
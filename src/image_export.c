@@ -0,0 +1,205 @@
+#include "image_export.h"
+#include <stb_image_write.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct ExportRequest ExportRequest;
+
+// The pixels are a private copy, so the caller can free its images as soon as the request is queued
+struct ExportRequest
+{
+	ExportRequest* next;
+	s8* path;
+	ImageExportFormat format;
+	s32 width, height, channels;
+	void* data;
+};
+
+static ImageExportFormat exportFormat = IMAGE_EXPORT_NONE;
+
+static pthread_once_t writerOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t requestQueued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queueEmpty = PTHREAD_COND_INITIALIZER;
+static ExportRequest* firstRequest;
+static ExportRequest* lastRequest;
+// True while the writer thread is writing a request that is not in the queue anymore
+static boolean isWriting;
+static boolean isWriterRunning;
+
+// Portable float map with the first three channels (or one channel for grayscale images). Rows are stored from bottom
+// to top, which is already the order of the rows in memory
+static s32 writePfm(const ExportRequest* request)
+{
+	FILE* file = fopen(request->path, "wb");
+	if (!file)
+		return 0;
+
+	s32 outputChannels = request->channels >= 3 ? 3 : 1;
+	const r32* data = request->data;
+	fprintf(file, "%s\n%d %d\n-1.0\n", outputChannels == 3 ? "PF" : "Pf", request->width, request->height);
+	for (s32 i = 0; i < request->width * request->height; ++i)
+		fwrite(&data[i * request->channels], sizeof(r32), outputChannels, file);
+
+	return fclose(file) == 0;
+}
+
+static void writeRequest(const ExportRequest* request)
+{
+	s32 success;
+
+	stbi_flip_vertically_on_write(1);
+	switch (request->format)
+	{
+		case IMAGE_EXPORT_BMP:
+			success = stbi_write_bmp(request->path, request->width, request->height, request->channels, request->data);
+			break;
+		case IMAGE_EXPORT_PNG:
+			success = stbi_write_png(request->path, request->width, request->height, request->channels, request->data,
+				request->width * request->channels);
+			break;
+		case IMAGE_EXPORT_PFM:
+			success = writePfm(request);
+			break;
+		default:
+			success = 0;
+			break;
+	}
+
+	if (success)
+		printf("Created %s\n", request->path);
+	else
+		fprintf(stderr, "Error writing debug image %s\n", request->path);
+}
+
+static void* writerMain(void* arg)
+{
+	pthread_mutex_lock(&queueMutex);
+	for (;;)
+	{
+		while (!firstRequest)
+			pthread_cond_wait(&requestQueued, &queueMutex);
+
+		ExportRequest* request = firstRequest;
+		firstRequest = request->next;
+		if (!firstRequest)
+			lastRequest = 0;
+		isWriting = true;
+		pthread_mutex_unlock(&queueMutex);
+
+		writeRequest(request);
+		free(request->path);
+		free(request->data);
+		free(request);
+
+		pthread_mutex_lock(&queueMutex);
+		isWriting = false;
+		if (!firstRequest)
+			pthread_cond_broadcast(&queueEmpty);
+	}
+
+	return 0;
+}
+
+static void startWriter()
+{
+	pthread_t thread;
+	if (pthread_create(&thread, 0, writerMain, 0))
+	{
+		fprintf(stderr, "Error creating debug image writer thread. Debug images will be written synchronously\n");
+		return;
+	}
+	pthread_detach(thread);
+	isWriterRunning = true;
+}
+
+static const s8* getExtension(ImageExportFormat format)
+{
+	switch (format)
+	{
+		case IMAGE_EXPORT_BMP: return ".bmp";
+		case IMAGE_EXPORT_PNG: return ".png";
+		case IMAGE_EXPORT_PFM: return ".pfm";
+		default: return "";
+	}
+}
+
+// Debug images are not written unless a format other than IMAGE_EXPORT_NONE is selected
+extern void imageExportSetFormat(ImageExportFormat format)
+{
+	exportFormat = format;
+}
+
+extern ImageExportFormat imageExportGetFormat()
+{
+	return exportFormat;
+}
+
+// Queues the image to be written to basePath plus the extension of the selected format, by a background thread.
+// 'image' is the normalized RGBA8 image and 'floatImage' holds the raw values, which are used by IMAGE_EXPORT_PFM
+extern void imageExportDebugImage(const s8* basePath, const ImageData* image, const FloatImageData* floatImage)
+{
+	ImageExportFormat format = exportFormat;
+	if (format == IMAGE_EXPORT_NONE)
+		return;
+
+	ExportRequest* request = malloc(sizeof(ExportRequest));
+	const s8* extension = getExtension(format);
+	request->next = 0;
+	request->path = malloc(strlen(basePath) + strlen(extension) + 1);
+	strcpy(request->path, basePath);
+	strcat(request->path, extension);
+	request->format = format;
+
+	size_t dataSize;
+	const void* data;
+	if (format == IMAGE_EXPORT_PFM)
+	{
+		request->width = floatImage->width;
+		request->height = floatImage->height;
+		request->channels = floatImage->channels;
+		dataSize = sizeof(r32) * floatImage->width * floatImage->height * floatImage->channels;
+		data = floatImage->data;
+	}
+	else
+	{
+		request->width = image->width;
+		request->height = image->height;
+		request->channels = image->channels;
+		dataSize = sizeof(u8) * image->width * image->height * image->channels;
+		data = image->data;
+	}
+	request->data = malloc(dataSize);
+	memcpy(request->data, data, dataSize);
+
+	pthread_once(&writerOnce, startWriter);
+
+	if (!isWriterRunning)
+	{
+		writeRequest(request);
+		free(request->path);
+		free(request->data);
+		free(request);
+		return;
+	}
+
+	pthread_mutex_lock(&queueMutex);
+	if (lastRequest)
+		lastRequest->next = request;
+	else
+		firstRequest = request;
+	lastRequest = request;
+	pthread_cond_signal(&requestQueued);
+	pthread_mutex_unlock(&queueMutex);
+}
+
+// Waits until all queued debug images were written
+extern void imageExportFlush()
+{
+	pthread_mutex_lock(&queueMutex);
+	while (firstRequest || isWriting)
+		pthread_cond_wait(&queueEmpty, &queueMutex);
+	pthread_mutex_unlock(&queueMutex);
+}
@@ -0,0 +1,20 @@
+#ifndef GIMMESH_IMAGE_EXPORT_H
+#define GIMMESH_IMAGE_EXPORT_H
+#include "graphics.h"
+
+// Format of the debug images (curvatures, normals, parametrization result). IMAGE_EXPORT_PFM stores the float values
+// before normalization (portable float map), the others store the normalized 8-bit image
+typedef enum
+{
+	IMAGE_EXPORT_NONE,
+	IMAGE_EXPORT_BMP,
+	IMAGE_EXPORT_PNG,
+	IMAGE_EXPORT_PFM
+} ImageExportFormat;
+
+extern void imageExportSetFormat(ImageExportFormat format);
+extern ImageExportFormat imageExportGetFormat();
+extern void imageExportDebugImage(const s8* basePath, const ImageData* image, const FloatImageData* floatImage);
+extern void imageExportFlush();
+
+#endif
@@ -0,0 +1,191 @@
+#include "image_planes.h"
+#include <stdlib.h>
+#include <assert.h>
+
+// Side of the square blocks used to transpose planes
+#define TRANSPOSE_BLOCK_SIZE 32
+
+// Number of floats between the beginning of two consecutive rows of the planes of a width wide image
+extern s32 imagePlanesGetStride(s32 width)
+{
+	// The stride is an odd multiple of IMAGE_PLANES_SIMD_WIDTH. When it is a multiple of a large power of two (e.g. a
+	// 2048 wide image), consecutive rows map to the same cache sets and walking a column, as the transpose does, thrashes the cache
+	s32 simdBlocks = (width + IMAGE_PLANES_SIMD_WIDTH - 1) / IMAGE_PLANES_SIMD_WIDTH;
+	if (simdBlocks % 2 == 0)
+		++simdBlocks;
+	return simdBlocks * IMAGE_PLANES_SIMD_WIDTH;
+}
+
+static size_t getElementSize(ImagePlanesPrecision precision)
+{
+	return (precision == IMAGE_PLANES_FP16) ? sizeof(u16) : sizeof(r32);
+}
+
+// Points the planes to 'memory', which must have imagePlanesGetMemorySize bytes aligned to IMAGE_PLANES_ALIGNMENT
+static ImagePlanes createImagePlanes(void* memory, s32 width, s32 height, s32 channels, ImagePlanesPrecision precision)
+{
+	ImagePlanes imagePlanes = {0};
+	assert(channels > 0 && channels <= IMAGE_PLANES_MAX_CHANNELS);
+
+	imagePlanes.width = width;
+	imagePlanes.height = height;
+	imagePlanes.channels = channels;
+	imagePlanes.stride = imagePlanesGetStride(width);
+	imagePlanes.precision = precision;
+
+	size_t planeSize = getElementSize(precision) * imagePlanes.stride * height;
+	for (s32 c = 0; c < channels; ++c)
+	{
+		if (precision == IMAGE_PLANES_FP16)
+			imagePlanes.halfPlanes[c] = (u16*)((u8*)memory + c * planeSize);
+		else
+			imagePlanes.planes[c] = (r32*)((u8*)memory + c * planeSize);
+	}
+
+	return imagePlanes;
+}
+
+// Number of bytes used by the planes of a width x height image
+extern size_t imagePlanesGetMemorySize(s32 width, s32 height, s32 channels, ImagePlanesPrecision precision)
+{
+	return getElementSize(precision) * imagePlanesGetStride(width) * height * channels;
+}
+
+// Creates the planes of a width x height image. All planes share a single aligned allocation
+extern ImagePlanes imagePlanesCreate(s32 width, s32 height, s32 channels, ImagePlanesPrecision precision)
+{
+	void* memory;
+	if (posix_memalign(&memory, IMAGE_PLANES_ALIGNMENT, imagePlanesGetMemorySize(width, height, channels, precision)))
+		return (ImagePlanes) {0};
+
+	ImagePlanes imagePlanes = createImagePlanes(memory, width, height, channels, precision);
+	imagePlanes.memory = memory;
+	return imagePlanes;
+}
+
+// Creates the planes of a width x height image inside 'arena'. They are released with the arena, not with imagePlanesFree
+extern ImagePlanes imagePlanesCreateInArena(Arena* arena, s32 width, s32 height, s32 channels, ImagePlanesPrecision precision)
+{
+	void* memory = arenaAlloc(arena, imagePlanesGetMemorySize(width, height, channels, precision));
+	if (!memory)
+		return (ImagePlanes) {0};
+
+	return createImagePlanes(memory, width, height, channels, precision);
+}
+
+// Copies the first numberOfChannels channels of img to the planes firstPlane, firstPlane + 1, ...
+extern void imagePlanesLoadChannels(ImagePlanes* imagePlanes, s32 firstPlane, s32 numberOfChannels, const FloatImageData* img)
+{
+	assert(img->width == imagePlanes->width && img->height == imagePlanes->height && img->channels >= numberOfChannels);
+	assert(firstPlane >= 0 && firstPlane + numberOfChannels <= imagePlanes->channels);
+
+	for (s32 i = 0; i < img->height; ++i)
+		for (s32 c = 0; c < numberOfChannels; ++c)
+		{
+			const r32* in = &img->data[i * img->width * img->channels + c];
+			if (imagePlanes->precision == IMAGE_PLANES_FP16)
+			{
+				u16* out = &imagePlanes->halfPlanes[firstPlane + c][i * imagePlanes->stride];
+				for (s32 j = 0; j < img->width; ++j)
+					out[j] = imagePlanesFloatToHalf(in[j * img->channels]);
+			}
+			else
+			{
+				r32* out = &imagePlanes->planes[firstPlane + c][i * imagePlanes->stride];
+				for (s32 j = 0; j < img->width; ++j)
+					out[j] = in[j * img->channels];
+			}
+		}
+}
+
+// Copies the first imagePlanes->channels channels of img to the planes
+extern void imagePlanesLoad(ImagePlanes* imagePlanes, const FloatImageData* img)
+{
+	imagePlanesLoadChannels(imagePlanes, 0, imagePlanes->channels, img);
+}
+
+// Copies the planes firstPlane, firstPlane + 1, ... back to the first numberOfChannels channels of img. Other channels of
+// img are not changed
+extern void imagePlanesStoreChannels(const ImagePlanes* imagePlanes, s32 firstPlane, s32 numberOfChannels, FloatImageData* img)
+{
+	assert(img->width == imagePlanes->width && img->height == imagePlanes->height && img->channels >= numberOfChannels);
+	assert(firstPlane >= 0 && firstPlane + numberOfChannels <= imagePlanes->channels);
+
+	for (s32 i = 0; i < img->height; ++i)
+		for (s32 c = 0; c < numberOfChannels; ++c)
+		{
+			r32* out = &img->data[i * img->width * img->channels + c];
+			if (imagePlanes->precision == IMAGE_PLANES_FP16)
+			{
+				const u16* in = &imagePlanes->halfPlanes[firstPlane + c][i * imagePlanes->stride];
+				for (s32 j = 0; j < img->width; ++j)
+					out[j * img->channels] = imagePlanesHalfToFloat(in[j]);
+			}
+			else
+			{
+				const r32* in = &imagePlanes->planes[firstPlane + c][i * imagePlanes->stride];
+				for (s32 j = 0; j < img->width; ++j)
+					out[j * img->channels] = in[j];
+			}
+		}
+}
+
+// Copies the planes back to the first imagePlanes->channels channels of img. Other channels of img are not changed
+extern void imagePlanesStore(const ImagePlanes* imagePlanes, FloatImageData* img)
+{
+	imagePlanesStoreChannels(imagePlanes, 0, imagePlanes->channels, img);
+}
+
+// Walks a height x width plane in square blocks, so both the reads and the writes of a block stay in cache, and copies
+// each value to the transposed position of 'out', converting it with CONVERT
+#define TRANSPOSE_PLANE(in, inStride, out, outStride, width, height, CONVERT) \
+	for (s32 blockI = 0; blockI < (height); blockI += TRANSPOSE_BLOCK_SIZE) \
+		for (s32 blockJ = 0; blockJ < (width); blockJ += TRANSPOSE_BLOCK_SIZE) \
+		{ \
+			s32 endI = (blockI + TRANSPOSE_BLOCK_SIZE < (height)) ? blockI + TRANSPOSE_BLOCK_SIZE : (height); \
+			s32 endJ = (blockJ + TRANSPOSE_BLOCK_SIZE < (width)) ? blockJ + TRANSPOSE_BLOCK_SIZE : (width); \
+			for (s32 i = blockI; i < endI; ++i) \
+				for (s32 j = blockJ; j < endJ; ++j) \
+					(out)[j * (outStride) + i] = CONVERT((in)[i * (inStride) + j]); \
+		}
+
+#define NO_CONVERSION(value) (value)
+
+// Transposes each plane. transposed must have been created with the transposed size and the same number of channels
+// The precision of transposed may differ from the precision of imagePlanes, then the values are converted
+extern void imagePlanesTranspose(const ImagePlanes* imagePlanes, ImagePlanes* transposed)
+{
+	assert(transposed->width == imagePlanes->height && transposed->height == imagePlanes->width && transposed->channels == imagePlanes->channels);
+
+	s32 width = imagePlanes->width;
+	s32 height = imagePlanes->height;
+	for (s32 c = 0; c < imagePlanes->channels; ++c)
+	{
+		if (imagePlanes->precision == IMAGE_PLANES_FP32 && transposed->precision == IMAGE_PLANES_FP32)
+		{
+			TRANSPOSE_PLANE(imagePlanes->planes[c], imagePlanes->stride, transposed->planes[c], transposed->stride, width, height,
+				NO_CONVERSION)
+		}
+		else if (imagePlanes->precision == IMAGE_PLANES_FP16 && transposed->precision == IMAGE_PLANES_FP16)
+		{
+			TRANSPOSE_PLANE(imagePlanes->halfPlanes[c], imagePlanes->stride, transposed->halfPlanes[c], transposed->stride, width, height,
+				NO_CONVERSION)
+		}
+		else if (imagePlanes->precision == IMAGE_PLANES_FP32)
+		{
+			TRANSPOSE_PLANE(imagePlanes->planes[c], imagePlanes->stride, transposed->halfPlanes[c], transposed->stride, width, height,
+				imagePlanesFloatToHalf)
+		}
+		else
+		{
+			TRANSPOSE_PLANE(imagePlanes->halfPlanes[c], imagePlanes->stride, transposed->planes[c], transposed->stride, width, height,
+				imagePlanesHalfToFloat)
+		}
+	}
+}
+
+extern void imagePlanesFree(ImagePlanes* imagePlanes)
+{
+	free(imagePlanes->memory);
+	*imagePlanes = (ImagePlanes) {0};
+}
@@ -0,0 +1,111 @@
+#ifndef GIMMESH_IMAGE_PLANES_H
+#define GIMMESH_IMAGE_PLANES_H
+#include "graphics.h"
+#include "arena.h"
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+// Number of floats processed together by SIMD instructions. Rows of the planes are padded to a multiple of it
+#define IMAGE_PLANES_SIMD_WIDTH 8
+// Alignment, in bytes, of each plane and of each row. It must not be larger than ARENA_ALIGNMENT
+#define IMAGE_PLANES_ALIGNMENT (IMAGE_PLANES_SIMD_WIDTH * sizeof(r32))
+#define IMAGE_PLANES_MAX_CHANNELS 16
+
+typedef enum ImagePlanesPrecision ImagePlanesPrecision;
+typedef struct ImagePlanes ImagePlanes;
+
+enum ImagePlanesPrecision
+{
+	IMAGE_PLANES_FP32 = 0,
+	// Half floats: 11 significant bits, so a relative error of up to 2^-11 for each stored value
+	IMAGE_PLANES_FP16 = 1,
+};
+
+// Structure of arrays representation of an image, used internally by the filter.
+// Each channel is stored in its own plane and the value of channel c at pixel <x, y> is planes[c][y * stride + x]
+// IMAGE_PLANES_FP16 planes store the values in halfPlanes instead, see imagePlanesHalfToFloat
+struct ImagePlanes
+{
+	r32* planes[IMAGE_PLANES_MAX_CHANNELS];
+	s32 width, height, channels;
+	s32 stride;
+	// Allocation owned by the planes, 0 when they live in an arena
+	void* memory;
+	ImagePlanesPrecision precision;
+	u16* halfPlanes[IMAGE_PLANES_MAX_CHANNELS];
+};
+
+// Converts a half float to a float
+static inline r32 imagePlanesHalfToFloat(u16 value)
+{
+#ifdef __F16C__
+	return _cvtsh_ss(value);
+#else
+	// Exponent and mantissa are moved to their positions in a float and the exponent is rebiased. Infinities and NaNs
+	// need a larger bias and denormals are normalized by a float subtraction
+	union { u32 u; r32 f; } result, magic = {113 << 23};
+	const u32 shiftedExponent = 0x7c00 << 13;
+
+	result.u = (u32)(value & 0x7fff) << 13;
+	u32 exponent = result.u & shiftedExponent;
+	result.u += (127 - 15) << 23;
+	if (exponent == shiftedExponent)
+		result.u += (128 - 16) << 23;
+	else if (exponent == 0)
+	{
+		result.u += 1 << 23;
+		result.f -= magic.f;
+	}
+	result.u |= (u32)(value & 0x8000) << 16;
+	return result.f;
+#endif
+}
+
+// Converts a float to the nearest half float, ties to even. Values out of the half float range become infinities
+static inline u16 imagePlanesFloatToHalf(r32 value)
+{
+#ifdef __F16C__
+	return _cvtss_sh(value, 0);
+#else
+	union { u32 u; r32 f; } in = {.f = value};
+	union { u32 u; r32 f; } denormalMagic = {((127 - 15) + (23 - 10) + 1) << 23};
+	const u32 infinity = 255 << 23;
+	const u32 halfOverflow = (127 + 16) << 23;
+	u16 result;
+
+	u32 sign = in.u & 0x80000000u;
+	in.u ^= sign;
+
+	if (in.u >= halfOverflow)
+		result = (in.u > infinity) ? 0x7e00 : 0x7c00;
+	else if (in.u < (113 << 23))
+	{
+		// Denormal half: the float addition aligns the mantissa and rounds it
+		in.f += denormalMagic.f;
+		result = (u16)(in.u - denormalMagic.u);
+	}
+	else
+	{
+		u32 oddMantissa = (in.u >> 13) & 1;
+		in.u += ((u32)(15 - 127) << 23) + 0xfff;
+		in.u += oddMantissa;
+		result = (u16)(in.u >> 13);
+	}
+
+	return result | (u16)(sign >> 16);
+#endif
+}
+
+extern s32 imagePlanesGetStride(s32 width);
+extern size_t imagePlanesGetMemorySize(s32 width, s32 height, s32 channels, ImagePlanesPrecision precision);
+extern ImagePlanes imagePlanesCreate(s32 width, s32 height, s32 channels, ImagePlanesPrecision precision);
+extern ImagePlanes imagePlanesCreateInArena(Arena* arena, s32 width, s32 height, s32 channels, ImagePlanesPrecision precision);
+extern void imagePlanesLoad(ImagePlanes* imagePlanes, const FloatImageData* img);
+extern void imagePlanesLoadChannels(ImagePlanes* imagePlanes, s32 firstPlane, s32 numberOfChannels, const FloatImageData* img);
+extern void imagePlanesStore(const ImagePlanes* imagePlanes, FloatImageData* img);
+extern void imagePlanesStoreChannels(const ImagePlanes* imagePlanes, s32 firstPlane, s32 numberOfChannels, FloatImageData* img);
+extern void imagePlanesTranspose(const ImagePlanes* imagePlanes, ImagePlanes* transposed);
+extern void imagePlanesFree(ImagePlanes* imagePlanes);
+
+#endif
@@ -5,16 +5,26 @@
 #include "core.h"
 #include "obj.h"
 #include "parametrization.h"
+#include "benchmark.h"
+#include "sweep.h"
+#include "sequence.h"
+#include "image_export.h"
 
 #define WINDOW_TITLE "gimmesh"
 #define SPHERICAL_PARAM_ITERATIONS_DEFAULT 500
 #define GIM_SIZE_DEFAULT 255
 #define GIM_PARAMETRIZATION_DEFAULT_PATH "./export.gim"
+#define SEQUENCE_OUTPUT_DEFAULT_PATTERN "./filtered_%04d.gim"
+#define FILTER_SPATIAL_FACTOR_DEFAULT 0.99f
+#define FILTER_RANGE_FACTOR_DEFAULT 2.0f
+#define FILTER_ITERATIONS_DEFAULT 3
+#define SEQUENCE_NORMAL_THRESHOLD_DEFAULT 0.01f
 
 s32 windowWidth = 1366;
 s32 windowHeight = 768;
 GLFWwindow* mainWindow;
 static s8* gimPath;
+static boolean checkBorderSymmetry = true;
 
 static boolean keyState[1024];	// @TODO: Check range.
 static boolean isMenuVisible = true;
@@ -121,13 +131,32 @@ static void printHelp(s8* app)
 	printf("To load a geometry image:\n\n");
 	printf("\t%s -g <example.gim>\n\n", app);
 	printf("Optional parameters:\n\n");
-	printf("\tNone\n\n");
+	printf("\t-nc\t\t: do not check the border symmetry of the geometry image when it is loaded\n\n");
 	printf("To load a wavefront object:\n\n");
 	printf("\t%s -o <example.obj>\n\n", app);
 	printf("Optional parameters:\n\n");
 	printf("\t-e <result.gim>\t: specify the path of the geometry image that will be generated (default: %s)\n", GIM_PARAMETRIZATION_DEFAULT_PATH);
 	printf("\t-it <number>\t: number of iterations for spherical parametrization algorithm (default: %d)\n", SPHERICAL_PARAM_ITERATIONS_DEFAULT);
 	printf("\t-s <number>\t: size of geometry image (<n> x <n>) [must be an odd number] (default: %d)\n", GIM_SIZE_DEFAULT);
+	printf("\nOptional parameters for both:\n\n");
+	printf("\t-d <bmp|png|pfm>\t: write debug images (curvatures, normals, parametrization result) to ./res (default: none)\n");
+	printf("\nTo benchmark the filter with a geometry image (the UI is not started):\n\n");
+	printf("\t%s -b <example.gim>\n", app);
+	printf("\nTo search the filter parameters that best restore a geometry image (the UI is not started):\n\n");
+	printf("\t%s -sw <reference.gim>\n\n", app);
+	printf("Optional parameters:\n\n");
+	printf("\t-sn <noisy.gim>\t: geometry image that is filtered (default: the reference with noise of intensity 0.5)\n");
+	printf("\nTo filter an animation, made of geometry images of the same size numbered from 0 (the UI is not started):\n\n");
+	printf("\t%s -sq <frame_%%04d.gim>\n\n", app);
+	printf("A path without a frame number filters a single geometry image, e.g. %s -sq <example.gim> -sqo <filtered.gim>\n", app);
+	printf("Paths may have one frame number (%%d or %%0Nd) and no other %% than %%%%\n\n");
+	printf("Optional parameters:\n\n");
+	printf("\t-sqo <filtered_%%04d.gim>\t: path of the filtered frames (default: %s)\n", SEQUENCE_OUTPUT_DEFAULT_PATTERN);
+	printf("\t-sqt <number>\t: distance a normal must move to update the domain transforms of its pixel (default: %g)\n",
+		SEQUENCE_NORMAL_THRESHOLD_DEFAULT);
+	printf("\t-fs <number>\t: spatial factor of the filter (default: %g)\n", FILTER_SPATIAL_FACTOR_DEFAULT);
+	printf("\t-fr <number>\t: range factor of the filter (default: %g)\n", FILTER_RANGE_FACTOR_DEFAULT);
+	printf("\t-fn <number>\t: number of iterations of the filter (default: %d)\n", FILTER_ITERATIONS_DEFAULT);
 }
 
 // Returns 0 if no error, but UI should not be started
@@ -138,6 +167,13 @@ static s32 parseArguments(s32 argc, s8** argv)
 	boolean validOptionSelected = false;
 	boolean convertObjToGeometryImage = false;
 	s8* objPath;
+	s8* benchmarkPath = 0;
+	s8* sweepReferencePath = 0;
+	s8* sweepNoisyPath = 0;
+	s8* sequenceInputPattern = 0;
+	s8* sequenceOutputPattern = SEQUENCE_OUTPUT_DEFAULT_PATTERN;
+	SequenceOptions sequenceOptions = {FILTER_ITERATIONS_DEFAULT, FILTER_SPATIAL_FACTOR_DEFAULT, FILTER_RANGE_FACTOR_DEFAULT, true,
+		SEQUENCE_NORMAL_THRESHOLD_DEFAULT};
 	s8* exportPath = GIM_PARAMETRIZATION_DEFAULT_PATH;
 	s32 sphericalParametrizationNumberOfIterations = SPHERICAL_PARAM_ITERATIONS_DEFAULT;
 	s32 gimSize = GIM_SIZE_DEFAULT;
@@ -182,6 +218,121 @@ static s32 parseArguments(s32 argc, s8** argv)
 			convertObjToGeometryImage = true;
 			objPath = argv[i++ + 1];
 		}
+		else if (!strcmp(arg, "-b"))
+		{
+			if (i == argc - 1)
+			{
+				fprintf(stderr, "-b requires an argument\n");
+				return -1;
+			}
+			if (validOptionSelected)
+			{
+				fprintf(stderr, "Invalid set of arguments\n");
+				return -1;
+			}
+			validOptionSelected = true;
+			benchmarkPath = argv[i++ + 1];
+		}
+		else if (!strcmp(arg, "-sw"))
+		{
+			if (i == argc - 1)
+			{
+				fprintf(stderr, "-sw requires an argument\n");
+				return -1;
+			}
+			if (validOptionSelected)
+			{
+				fprintf(stderr, "Invalid set of arguments\n");
+				return -1;
+			}
+			validOptionSelected = true;
+			sweepReferencePath = argv[i++ + 1];
+		}
+		else if (!strcmp(arg, "-sn"))
+		{
+			if (i == argc - 1)
+			{
+				fprintf(stderr, "-sn requires an argument\n");
+				return -1;
+			}
+			sweepNoisyPath = argv[i++ + 1];
+		}
+		else if (!strcmp(arg, "-sq"))
+		{
+			if (i == argc - 1)
+			{
+				fprintf(stderr, "-sq requires an argument\n");
+				return -1;
+			}
+			if (validOptionSelected)
+			{
+				fprintf(stderr, "Invalid set of arguments\n");
+				return -1;
+			}
+			validOptionSelected = true;
+			sequenceInputPattern = argv[i++ + 1];
+		}
+		else if (!strcmp(arg, "-sqo"))
+		{
+			if (i == argc - 1)
+			{
+				fprintf(stderr, "-sqo requires an argument\n");
+				return -1;
+			}
+			sequenceOutputPattern = argv[i++ + 1];
+		}
+		else if (!strcmp(arg, "-sqt"))
+		{
+			if (i == argc - 1)
+			{
+				fprintf(stderr, "-sqt requires an argument\n");
+				return -1;
+			}
+			sequenceOptions.normalThreshold = atof(argv[i++ + 1]);
+			if (sequenceOptions.normalThreshold < 0.0f) {
+				fprintf(stderr, "Invalid normal threshold: can't be negative.\n");
+				return -1;
+			}
+		}
+		else if (!strcmp(arg, "-fs"))
+		{
+			if (i == argc - 1)
+			{
+				fprintf(stderr, "-fs requires an argument\n");
+				return -1;
+			}
+			sequenceOptions.spatialFactor = atof(argv[i++ + 1]);
+			if (sequenceOptions.spatialFactor <= 0.0f) {
+				fprintf(stderr, "Invalid spatial factor: must be positive.\n");
+				return -1;
+			}
+		}
+		else if (!strcmp(arg, "-fr"))
+		{
+			if (i == argc - 1)
+			{
+				fprintf(stderr, "-fr requires an argument\n");
+				return -1;
+			}
+			sequenceOptions.rangeFactor = atof(argv[i++ + 1]);
+			if (sequenceOptions.rangeFactor <= 0.0f) {
+				fprintf(stderr, "Invalid range factor: must be positive.\n");
+				return -1;
+			}
+		}
+		else if (!strcmp(arg, "-fn"))
+		{
+			if (i == argc - 1)
+			{
+				fprintf(stderr, "-fn requires an argument\n");
+				return -1;
+			}
+			sequenceOptions.numIterations = atoi(argv[i++ + 1]);
+			if (sequenceOptions.numIterations <= 0) {
+				fprintf(stderr, "Invalid number of iterations of the filter.\n");
+				return -1;
+			}
+		}
 		else if (!strcmp(arg, "-e"))
 		{
 			if (i == argc - 1)
@@ -220,6 +371,30 @@ static s32 parseArguments(s32 argc, s8** argv)
 				return -1;
 			}
 		}
+		else if (!strcmp(arg, "-nc"))
+		{
+			checkBorderSymmetry = false;
+		}
+		else if (!strcmp(arg, "-d"))
+		{
+			if (i == argc - 1)
+			{
+				fprintf(stderr, "-d requires an argument\n");
+				return -1;
+			}
+			s8* format = argv[i++ + 1];
+			if (!strcmp(format, "bmp"))
+				imageExportSetFormat(IMAGE_EXPORT_BMP);
+			else if (!strcmp(format, "png"))
+				imageExportSetFormat(IMAGE_EXPORT_PNG);
+			else if (!strcmp(format, "pfm"))
+				imageExportSetFormat(IMAGE_EXPORT_PFM);
+			else
+			{
+				fprintf(stderr, "Invalid debug image format: %s\n", format);
+				return -1;
+			}
+		}
 		else if (!strcmp(arg, "-h") || !strcmp(arg, "--help"))
 		{
 			printHelp(argv[0]);
@@ -232,6 +407,15 @@ static s32 parseArguments(s32 argc, s8** argv)
 		}
 	}
 
+	if (benchmarkPath)
+		return benchmarkRun(benchmarkPath) ? -1 : 0;
+
+	if (sweepReferencePath)
+		return sweepRunFromFiles(sweepReferencePath, sweepNoisyPath) ? -1 : 0;
+
+	if (sequenceInputPattern)
+		return sequenceFilterFiles(sequenceInputPattern, sequenceOutputPattern, &sequenceOptions) ? -1 : 0;
+
 	if (convertObjToGeometryImage)
 	{
 		GeometryImage gim;
@@ -242,7 +426,9 @@ static s32 parseArguments(s32 argc, s8** argv)
 			fprintf(stderr, "Error parsing wavefront file.\n");
 			return -1;
 		}
-		if (paramObjToGeometryImage(indexes, vertices, exportPath, sphericalParametrizationNumberOfIterations, gimSize))
+		s32 parametrizationResult = paramObjToGeometryImage(indexes, vertices, exportPath, sphericalParametrizationNumberOfIterations, gimSize);
+		imageExportFlush();
+		if (parametrizationResult)
 		{
 			fprintf(stderr, "Error converting wavefront to geometry image.\n");
 			array_release(vertices);
@@ -268,7 +454,7 @@ extern s32 main(s32 argc, s8** argv)
 	mainWindow = initGlfw();
 	initGlew();
 
-	if (coreInit(gimPath))
+	if (coreInit(gimPath, checkBorderSymmetry))
 		return -1;
 
 	glEnable(GL_DEPTH_TEST);
@@ -14,15 +14,17 @@
 #define GLSL_VERSION "#version 330"
 #define MENU_TITLE "DT-SGIM Filter"
 
-typedef void (*FilterCallback)(r32, r32, s32);
+typedef void (*FilterCallback)(r32, r32, s32, r32, s32);
 typedef void (*TextureChangeSolidCallback)();
 typedef void (*TextureChangeCurvatureCallback)(r32, r32);
 typedef void (*TextureChangeNormalsCallback)(r32);
 typedef void (*TextureChangeCustomCallback)(char*);
-typedef void (*NoiseGeneratorCallback)(r32);
+typedef void (*NoiseGeneratorCallback)(r32, s32);
 typedef void (*ExportWavefrontCallback)();
 typedef void (*ExportPointCloudCallback)();
 typedef void (*ExportGimCallback)();
+typedef void (*FilterRegionCallback)(r32, r32, s32, s32, s32, s32, s32);
+typedef void (*DebugImageFormatCallback)(s32);
 
 static FilterCallback filterCallback;
 static TextureChangeSolidCallback textureChangeSolidCallback;
@@ -33,6 +35,14 @@ static NoiseGeneratorCallback noiseGeneratorCallback;
 static ExportWavefrontCallback exportWavefrontCallback;
 static ExportPointCloudCallback exportPointCloudCallback;
 static ExportGimCallback exportGimCallback;
+static FilterRegionCallback filterRegionCallback;
+static DebugImageFormatCallback debugImageFormatCallback;
+
+// Center set by menuSetFilterRegionCenter. It is applied to the filter region the next time the menu is drawn and shown
+// under it afterwards
+static bool hasPickedPixel;
+static bool isPickedPixelPending;
+static s32 pickedPixel[2];
 
 static char** availableCustomTexturesPaths;
 
@@ -81,6 +91,25 @@ extern "C" void menuRegisterExportGimCallBack(ExportGimCallback f)
 	exportGimCallback = f;
 }
 
+extern "C" void menuRegisterFilterRegionCallBack(FilterRegionCallback f)
+{
+	filterRegionCallback = f;
+}
+
+extern "C" void menuRegisterDebugImageFormatCallBack(DebugImageFormatCallback f)
+{
+	debugImageFormatCallback = f;
+}
+
+// Moves the filter region, keeping its size, so that it is centered at pixel <x, y> of the geometry image
+extern "C" void menuSetFilterRegionCenter(s32 x, s32 y)
+{
+	hasPickedPixel = true;
+	isPickedPixelPending = true;
+	pickedPixel[0] = x;
+	pickedPixel[1] = y;
+}
+
 extern "C" void menuCharClickProcess(GLFWwindow* window, u32 c)
 {
 	ImGui_ImplGlfw_CharCallback(window, c);
@@ -141,12 +170,27 @@ static void drawMainWindow()
 	static r32 filterSpatialFactor = 0.99f;//100.0f;
 	static r32 filterRangeFactor = 2.0;
 	static s32 filterNumberOfIterations = 3;
+	static bool filterAdaptive = false;
+	static r32 filterConvergenceTolerance = 0.0001f;
+	static s32 filterNumberOfPyramidLevels = 0;
+	static s32 filterRegion[4] = {0, 0, 64, 64};
 	static s32 filterBlurNumberOfIterations = 3;
 	
 	static r32 noiseIntensity = 0.0f;
+	static s32 noiseSeed = 0;
 
 	static s32 textureRadioSelection = 0;
 
+	// The region is clipped to the geometry image when filtered, so only negative corners need to be fixed
+	if (isPickedPixelPending)
+	{
+		filterRegion[0] = pickedPixel[0] - filterRegion[2] / 2;
+		filterRegion[1] = pickedPixel[1] - filterRegion[3] / 2;
+		if (filterRegion[0] < 0) filterRegion[0] = 0;
+		if (filterRegion[1] < 0) filterRegion[1] = 0;
+		isPickedPixelPending = false;
+	}
+
 	// Main body of the Demo window starts here.
 	if (!ImGui::Begin(MENU_TITLE, 0, 0))
 	{
@@ -159,6 +203,7 @@ static void drawMainWindow()
 	ImGui::Text("Press [SHIFT] to move slowly.");
 	ImGui::Text("Press [X/Y/Z] to rotate.");
 	ImGui::Text("Press [ESC] to open/close menu.");
+	ImGui::Text("Click with the menu closed to center the filter region at the middle of the screen.");
 
 	ImGui::Separator();
 
@@ -167,21 +212,39 @@ static void drawMainWindow()
 		ImGui::DragFloat("Spatial Factor##curvature", &filterSpatialFactor, 0.1f, 0.0f, 100.0f, "%.3f");
 		ImGui::DragFloat("Range Factor##curvature", &filterRangeFactor, 0.002f, 0.0f, 2.0f, "%.3f");
 		ImGui::DragInt("Number of Iterations##curvature", &filterNumberOfIterations, 0.02f, 1, 10);
+		// When adaptive, the number of iterations is the maximum and the filter stops once an iteration barely moves the vertices
+		ImGui::Checkbox("Adaptive##curvature", &filterAdaptive);
+		if (filterAdaptive)
+			ImGui::DragFloat("Tolerance##curvature", &filterConvergenceTolerance, 0.00001f, 0.000001f, 0.01f, "%.6f");
+		ImGui::DragInt("Pyramid Levels##curvature", &filterNumberOfPyramidLevels, 0.02f, 0, 6);
 
 		if (ImGui::Button("Filter##curvature"))
 		{
 			if (filterCallback)
-				filterCallback(filterSpatialFactor, filterRangeFactor, filterNumberOfIterations);
+				filterCallback(filterSpatialFactor, filterRangeFactor, filterNumberOfIterations,
+					filterAdaptive ? filterConvergenceTolerance : 0.0f, filterNumberOfPyramidLevels);
+		}
+
+		ImGui::DragInt4("Region (x, y, w, h)##curvature", filterRegion, 1.0f, 0, 8192);
+		if (hasPickedPixel)
+			ImGui::Text("Picked pixel: <%d, %d>", pickedPixel[0], pickedPixel[1]);
+
+		if (ImGui::Button("Filter Region##curvature"))
+		{
+			if (filterRegionCallback)
+				filterRegionCallback(filterSpatialFactor, filterRangeFactor, filterNumberOfIterations,
+					filterRegion[0], filterRegion[1], filterRegion[2], filterRegion[3]);
 		}
 	}
 	
 	if (ImGui::CollapsingHeader("Noise Generator"))
 	{
 		ImGui::DragFloat("Intensity##noise", &noiseIntensity, 0.001f, 0.0f, 1.0f);
+		ImGui::InputInt("Seed##noise", &noiseSeed);
 		if (ImGui::Button("Apply##noise"))
 		{
 			if (noiseGeneratorCallback)
-				noiseGeneratorCallback(noiseIntensity);
+				noiseGeneratorCallback(noiseIntensity, noiseSeed);
 		}
 	}
 
@@ -246,6 +309,15 @@ static void drawMainWindow()
 			if (exportGimCallback)
 				exportGimCallback();
 		}
+
+		// Same order as ImageExportFormat
+		static const char* debugImageFormats[] = {"None", "BMP", "PNG", "PFM (float)"};
+		static s32 debugImageFormat = 0;
+		if (ImGui::Combo("Debug images##export", &debugImageFormat, debugImageFormats, IM_ARRAYSIZE(debugImageFormats)))
+		{
+			if (debugImageFormatCallback)
+				debugImageFormatCallback(debugImageFormat);
+		}
 	}
 
 	ImGui::End();
@@ -3,15 +3,17 @@
 #include <GLFW/glfw3.h>
 #include "common.h"
 
-typedef void (*FilterCallback)(r32, r32, s32);
+typedef void (*FilterCallback)(r32, r32, s32, r32, s32);
 typedef void (*TextureChangeSolidCallback)();
 typedef void (*TextureChangeCurvatureCallback)(r32, r32);
 typedef void (*TextureChangeNormalsCallback)(r32);
 typedef void (*TextureChangeCustomCallback)(char*);
-typedef void (*NoiseGeneratorCallback)(r32);
+typedef void (*NoiseGeneratorCallback)(r32, s32);
 typedef void (*ExportWavefrontCallback)();
 typedef void (*ExportPointCloudCallback)();
 typedef void (*ExportGimCallback)();
+typedef void (*FilterRegionCallback)(r32, r32, s32, s32, s32, s32, s32);
+typedef void (*DebugImageFormatCallback)(s32);
 
 extern void menuRegisterNoiseGeneratorCallBack(NoiseGeneratorCallback f);
 extern void menuRegisterFilterCallBack(FilterCallback f);
@@ -22,6 +24,9 @@ extern void menuRegisterTextureChangeCustomCallBack(TextureChangeCustomCallback
 extern void menuRegisterExportWavefrontCallBack();
 extern void menuRegisterExportPointCloudCallBack();
 extern void menuRegisterExportGimCallBack(ExportGimCallback f);
+extern void menuRegisterFilterRegionCallBack(FilterRegionCallback f);
+extern void menuRegisterDebugImageFormatCallBack(DebugImageFormatCallback f);
+extern void menuSetFilterRegionCenter(s32 x, s32 y);
 extern void menuCharClickProcess(GLFWwindow* window, u32 c);
 extern void menuKeyClickProcess(GLFWwindow* window, s32 key, s32 scanCode, s32 action, s32 mods);
 extern void menuMouseClickProcess(GLFWwindow* window, s32 button, s32 action, s32 mods);
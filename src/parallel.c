@@ -0,0 +1,141 @@
+#include "parallel.h"
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct
+{
+	ParallelForFunc func;
+	void* data;
+	s32 count;
+	s32 grainSize;
+	// First item of the next chunk. Chunks are taken with an atomic add, so faster threads take more chunks
+	s32 nextBegin;
+	// Workers that did not finish the current job yet
+	s32 pendingWorkers;
+	u32 generation;
+} ParallelJob;
+
+static pthread_once_t poolOnce = PTHREAD_ONCE_INIT;
+// Protects the job. Only one job runs at a time, submitMutex serializes callers from different threads
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t submitMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobStarted = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobFinished = PTHREAD_COND_INITIALIZER;
+static ParallelJob job;
+static s32 numberOfWorkers;
+// Nested calls run serially in the calling thread
+static __thread boolean isInsideJob;
+// 0 for threads that are not workers, see parallelGetThreadIndex
+static __thread s32 threadIndex;
+
+static void runChunks(ParallelJob* job)
+{
+	for (;;)
+	{
+		s32 begin = __atomic_fetch_add(&job->nextBegin, job->grainSize, __ATOMIC_RELAXED);
+		if (begin >= job->count)
+			break;
+
+		s32 end = begin + job->grainSize;
+		if (end > job->count)
+			end = job->count;
+		job->func(begin, end, job->data);
+	}
+}
+
+static void* workerMain(void* arg)
+{
+	u32 lastGeneration = 0;
+	isInsideJob = true;
+	threadIndex = (s32)(intptr_t)arg;
+
+	pthread_mutex_lock(&poolMutex);
+	for (;;)
+	{
+		while (job.generation == lastGeneration)
+			pthread_cond_wait(&jobStarted, &poolMutex);
+		lastGeneration = job.generation;
+		pthread_mutex_unlock(&poolMutex);
+
+		runChunks(&job);
+
+		pthread_mutex_lock(&poolMutex);
+		if (--job.pendingWorkers == 0)
+			pthread_cond_signal(&jobFinished);
+	}
+
+	return 0;
+}
+
+// The workers live until the program exits. The calling thread of parallelFor also processes chunks, so one thread less
+// than the number of processors is created
+static void createWorkers()
+{
+	s64 numberOfProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numberOfProcessors > PARALLEL_MAX_THREADS)
+		numberOfProcessors = PARALLEL_MAX_THREADS;
+
+	for (s64 i = 1; i < numberOfProcessors; ++i)
+	{
+		pthread_t thread;
+		if (pthread_create(&thread, 0, workerMain, (void*)(intptr_t)i))
+			break;
+		pthread_detach(thread);
+		++numberOfWorkers;
+	}
+}
+
+extern s32 parallelGetNumberOfThreads()
+{
+	pthread_once(&poolOnce, createWorkers);
+	return numberOfWorkers + 1;
+}
+
+// Index of the calling thread, in [0, parallelGetNumberOfThreads()). Threads that run chunks of the same parallelFor have
+// different indexes, so it can select per-thread scratch memory
+extern s32 parallelGetThreadIndex()
+{
+	return threadIndex;
+}
+
+// Calls func over [0, count) split in chunks of grainSize items, which are distributed among the threads.
+// Returns when all chunks were processed. Chunks may run in any order, so func must not depend on it
+extern void parallelFor(s32 count, s32 grainSize, ParallelForFunc func, void* data)
+{
+	if (count <= 0)
+		return;
+	if (grainSize < 1)
+		grainSize = 1;
+
+	pthread_once(&poolOnce, createWorkers);
+
+	if (isInsideJob || numberOfWorkers == 0 || count <= grainSize)
+	{
+		func(0, count, data);
+		return;
+	}
+
+	pthread_mutex_lock(&submitMutex);
+
+	pthread_mutex_lock(&poolMutex);
+	job.func = func;
+	job.data = data;
+	job.count = count;
+	job.grainSize = grainSize;
+	job.nextBegin = 0;
+	job.pendingWorkers = numberOfWorkers;
+	++job.generation;
+	pthread_cond_broadcast(&jobStarted);
+	pthread_mutex_unlock(&poolMutex);
+
+	isInsideJob = true;
+	runChunks(&job);
+	isInsideJob = false;
+
+	pthread_mutex_lock(&poolMutex);
+	while (job.pendingWorkers > 0)
+		pthread_cond_wait(&jobFinished, &poolMutex);
+	pthread_mutex_unlock(&poolMutex);
+
+	pthread_mutex_unlock(&submitMutex);
+}
@@ -0,0 +1,15 @@
+#ifndef GIMMESH_PARALLEL_H
+#define GIMMESH_PARALLEL_H
+#include "common.h"
+
+// Upper bound for the number of threads used by parallelFor, including the calling thread
+#define PARALLEL_MAX_THREADS 64
+
+// Processes the items in [begin, end)
+typedef void (*ParallelForFunc)(s32 begin, s32 end, void* data);
+
+extern s32 parallelGetNumberOfThreads();
+extern s32 parallelGetThreadIndex();
+extern void parallelFor(s32 count, s32 grainSize, ParallelForFunc func, void* data);
+
+#endif
@@ -4,6 +4,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include "hash_map.h"
+#include "image_export.h"
 
 static Vec3 convertToBarycentricCoordinates3D(Vec3 a, Vec3 b, Vec3 c, Vec3 p)
 {
@@ -113,18 +114,6 @@ static Vec3 convertFromBarycentricToEuler3D(Vec3 a, Vec3 b, Vec3 c, Vec3 barycen
 	return result;
 }
 
-static int key_compare(const void *key1, const void *key2)
-{
-	u64 u1 = *(u64*)key1;
-	u64 u2 = *(u64*)key2;
-	return u1 == u2;
-}
-
-unsigned int key_hash(const void *key)
-{
-	return (u32)*(u64*)key;
-}
-
 // Parametrizes the received mesh into a sphere and return the new set of vertices
 static Vec3* performSphericalParametrization(const Vertex* vertices, u32* indexes, u32 numberOfIterations)
 {
@@ -156,18 +145,23 @@ static Vec3* performSphericalParametrization(const Vertex* vertices, u32* indexe
 	}
 
 	// W = make_sparse( E(1,:), E(2,:), ones(size(E,2),1) );
-	Hash_Map W;
-	hash_map_create(&W, 1024, sizeof(u64), sizeof(u32), key_compare, key_hash);
-	//u32* W = calloc(sizeof(s32), numberOfVertices * numberOfVertices);
-	for (u32 i = 0; i < array_get_length(E); ++i)
+	u32 numberOfEdges = array_get_length(E);
+	u64* keys = malloc(sizeof(u64) * numberOfEdges);
+	u32* values = malloc(sizeof(u32) * numberOfEdges);
+	for (u32 i = 0; i < numberOfEdges; ++i)
 	{
 		DiscreteVec2 current = E[i];
-		u64 key = current.y * (u64)numberOfVertices + current.x;
-		u32 value = 1;
-		assert(hash_map_put(&W, &key, &value) == 0);
-		//W[current.y * numberOfVertices + current.x] = 1;
+		keys[i] = current.y * (u64)numberOfVertices + current.x;
+		values[i] = 1;
 	}
 
+	Hash_Map W;
+	hash_map_create(&W, numberOfEdges);
+	int putResult = hash_map_put_bulk(&W, keys, values, numberOfEdges);
+	assert(putResult == 0);
+
+	free(keys);
+	free(values);
 	array_release(E);
 
 	// d = full( sum(W,1) );
@@ -182,7 +176,7 @@ static Vec3* performSphericalParametrization(const Vertex* vertices, u32* indexe
 		{
 			u64 key = i * (u64)numberOfVertices + j;
 			u32 value;
-			if (hash_map_get(&W, &key, &value) == 0 && value == 1)
+			if (hash_map_get(&W, key, &value) == 0 && value == 1)
 			{
 				++currentSum;
 			}
@@ -198,7 +192,7 @@ static Vec3* performSphericalParametrization(const Vertex* vertices, u32* indexe
 		{
 			u64 key = i * (u64)numberOfVertices + j;
 			u32 value;
-			if (hash_map_get(&W, &key, &value) == 0 && value == 1) {
+			if (hash_map_get(&W, key, &value) == 0 && value == 1) {
 				DiscreteVec2 pos = (DiscreteVec2){i, j};
 				r32 v = 1.0f / d[i];
 				array_push(tWIndexes, &pos);
@@ -611,8 +605,12 @@ extern int paramObjToGeometryImage(u32* indexes, Vertex* vertices, const s8* out
 
 	sphericalParametrizationToGeometryImage(&gim, gimSize, triangleGroups, vertices, parametrizedVertices);
 
-	// @TEMPORARY
-	gimNormalizeAndSave(&gim, "./res/result.bmp");
+	if (imageExportGetFormat() != IMAGE_EXPORT_NONE)
+	{
+		ImageData normalizedImage = gimNormalizeImageForVisualization(&gim.img);
+		imageExportDebugImage("./res/result", &normalizedImage, &gim.img);
+		graphicsImageFree(&normalizedImage);
+	}
 	gimExportToGimFile(&gim, outPath);
 	gimFreeGeometryImage(&gim);
 
@@ -0,0 +1,335 @@
+#include "pick.h"
+#include "parallel.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Used instead of the inverse of a zero component of the direction, fast math does not handle infinities
+#define PICK_HUGE 1e30f
+// Determinant under which a triangle is considered parallel to the ray
+#define PICK_PARALLEL_EPSILON 1e-12f
+
+typedef struct
+{
+	PickPyramid* pyramid;
+	const FloatImageData* img;
+	s32 level;
+	s32 firstX, lastX;
+	s32 firstY;
+} PickBuildJob;
+
+typedef struct
+{
+	const PickPyramid* pyramid;
+	const FloatImageData* img;
+	Vec3 origin;
+	Vec3 direction;
+	Vec3 inverseDirection;
+	r32 bestDistance;
+	boolean hit;
+	PickResult* result;
+} PickRay;
+
+static void growBounds(PickBounds* bounds, const r32* position)
+{
+	if (position[0] < bounds->min.x) bounds->min.x = position[0];
+	if (position[1] < bounds->min.y) bounds->min.y = position[1];
+	if (position[2] < bounds->min.z) bounds->min.z = position[2];
+	if (position[0] > bounds->max.x) bounds->max.x = position[0];
+	if (position[1] > bounds->max.y) bounds->max.y = position[1];
+	if (position[2] > bounds->max.z) bounds->max.z = position[2];
+}
+
+static void mergeBounds(PickBounds* bounds, const PickBounds* other)
+{
+	growBounds(bounds, &other->min.x);
+	growBounds(bounds, &other->max.x);
+}
+
+// Bounds of the pixels of the cells of tile <tx, ty>, including the pixels shared with the next tiles
+static PickBounds getTileBounds(const FloatImageData* img, s32 tx, s32 ty)
+{
+	s32 c = img->channels;
+	s32 firstX = tx * PICK_TILE_SIZE, lastX = firstX + PICK_TILE_SIZE;
+	s32 firstY = ty * PICK_TILE_SIZE, lastY = firstY + PICK_TILE_SIZE;
+	if (lastX > img->width - 1) lastX = img->width - 1;
+	if (lastY > img->height - 1) lastY = img->height - 1;
+
+	const r32* first = &img->data[(firstY * img->width + firstX) * c];
+	PickBounds bounds = {{{first[0], first[1], first[2]}}, {{first[0], first[1], first[2]}}};
+	for (s32 y = firstY; y <= lastY; ++y)
+	{
+		const r32* row = &img->data[y * img->width * c];
+		for (s32 x = firstX; x <= lastX; ++x)
+			growBounds(&bounds, &row[x * c]);
+	}
+	return bounds;
+}
+
+static void buildRows(s32 begin, s32 end, void* data)
+{
+	PickBuildJob* job = data;
+	PickPyramid* pyramid = job->pyramid;
+	s32 level = job->level;
+	s32 levelWidth = pyramid->levelWidths[level];
+
+	for (s32 y = job->firstY + begin; y < job->firstY + end; ++y)
+		for (s32 x = job->firstX; x <= job->lastX; ++x)
+		{
+			PickBounds* bounds = &pyramid->levels[level][y * levelWidth + x];
+			if (level == 0)
+			{
+				*bounds = getTileBounds(job->img, x, y);
+				continue;
+			}
+
+			const PickBounds* children = pyramid->levels[level - 1];
+			s32 childrenWidth = pyramid->levelWidths[level - 1];
+			s32 childrenHeight = pyramid->levelHeights[level - 1];
+			*bounds = children[2 * y * childrenWidth + 2 * x];
+			if (2 * x + 1 < childrenWidth)
+				mergeBounds(bounds, &children[2 * y * childrenWidth + 2 * x + 1]);
+			if (2 * y + 1 < childrenHeight)
+			{
+				mergeBounds(bounds, &children[(2 * y + 1) * childrenWidth + 2 * x]);
+				if (2 * x + 1 < childrenWidth)
+					mergeBounds(bounds, &children[(2 * y + 1) * childrenWidth + 2 * x + 1]);
+			}
+		}
+}
+
+// Recalculates the boxes of tiles <firstX, firstY> to <lastX, lastY> and their ancestors
+static void buildTiles(PickPyramid* pyramid, const FloatImageData* img, s32 firstX, s32 firstY, s32 lastX, s32 lastY)
+{
+	for (s32 level = 0; level < pyramid->numberOfLevels; ++level)
+	{
+		PickBuildJob job = {pyramid, img, level, firstX, lastX, firstY};
+		// Rows of the first level read PICK_TILE_SIZE image rows each, the upper levels are much cheaper
+		s32 grainSize = level == 0 ? 1 : 64;
+		parallelFor(lastY - firstY + 1, grainSize, buildRows, &job);
+
+		firstX /= 2;
+		firstY /= 2;
+		lastX /= 2;
+		lastY /= 2;
+	}
+}
+
+static void allocateLevels(PickPyramid* pyramid, s32 width, s32 height)
+{
+	pickPyramidDestroy(pyramid);
+	pyramid->width = width;
+	pyramid->height = height;
+	if (width < 2 || height < 2)
+		return;
+
+	s32 levelWidth = (width - 2) / PICK_TILE_SIZE + 1;
+	s32 levelHeight = (height - 2) / PICK_TILE_SIZE + 1;
+	for (;;)
+	{
+		s32 level = pyramid->numberOfLevels++;
+		pyramid->levelWidths[level] = levelWidth;
+		pyramid->levelHeights[level] = levelHeight;
+		pyramid->levels[level] = malloc(sizeof(PickBounds) * levelWidth * levelHeight);
+		if (levelWidth == 1 && levelHeight == 1)
+			break;
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+}
+
+// Recalculates all boxes of the pyramid from the positions of img, allocating the pyramid when it is empty or has a
+// different size
+extern void pickPyramidUpdate(PickPyramid* pyramid, const FloatImageData* img)
+{
+	if (!pyramid->numberOfLevels || pyramid->width != img->width || pyramid->height != img->height)
+		allocateLevels(pyramid, img->width, img->height);
+	if (!pyramid->numberOfLevels)
+		return;
+
+	buildTiles(pyramid, img, 0, 0, pyramid->levelWidths[0] - 1, pyramid->levelHeights[0] - 1);
+}
+
+// Recalculates only the boxes that depend on the pixels of the region <x, y, width, height>, which must be inside img.
+// Must be used after the pyramid was built with pickPyramidUpdate for an image of the same size
+extern void pickPyramidUpdateRegion(PickPyramid* pyramid, const FloatImageData* img, s32 x, s32 y, s32 width, s32 height)
+{
+	if (!pyramid->numberOfLevels || width <= 0 || height <= 0)
+		return;
+
+	// Cells x - 1 to x + width - 1 have vertices in the region
+	s32 firstX = (x > 0 ? x - 1 : 0) / PICK_TILE_SIZE;
+	s32 firstY = (y > 0 ? y - 1 : 0) / PICK_TILE_SIZE;
+	s32 lastX = (x + width - 1) / PICK_TILE_SIZE;
+	s32 lastY = (y + height - 1) / PICK_TILE_SIZE;
+	if (lastX > pyramid->levelWidths[0] - 1) lastX = pyramid->levelWidths[0] - 1;
+	if (lastY > pyramid->levelHeights[0] - 1) lastY = pyramid->levelHeights[0] - 1;
+
+	buildTiles(pyramid, img, firstX, firstY, lastX, lastY);
+}
+
+extern void pickPyramidDestroy(PickPyramid* pyramid)
+{
+	for (s32 level = 0; level < pyramid->numberOfLevels; ++level)
+		free(pyramid->levels[level]);
+	memset(pyramid, 0, sizeof(PickPyramid));
+}
+
+// Distance along the ray at which it enters the box, or -1 if it misses the box or enters it after the closest hit so far
+static r32 intersectBounds(const PickRay* ray, const PickBounds* bounds)
+{
+	r32 t1 = (bounds->min.x - ray->origin.x) * ray->inverseDirection.x;
+	r32 t2 = (bounds->max.x - ray->origin.x) * ray->inverseDirection.x;
+	r32 tMin = t1 < t2 ? t1 : t2;
+	r32 tMax = t1 < t2 ? t2 : t1;
+
+	t1 = (bounds->min.y - ray->origin.y) * ray->inverseDirection.y;
+	t2 = (bounds->max.y - ray->origin.y) * ray->inverseDirection.y;
+	if ((t1 < t2 ? t1 : t2) > tMin) tMin = t1 < t2 ? t1 : t2;
+	if ((t1 < t2 ? t2 : t1) < tMax) tMax = t1 < t2 ? t2 : t1;
+
+	t1 = (bounds->min.z - ray->origin.z) * ray->inverseDirection.z;
+	t2 = (bounds->max.z - ray->origin.z) * ray->inverseDirection.z;
+	if ((t1 < t2 ? t1 : t2) > tMin) tMin = t1 < t2 ? t1 : t2;
+	if ((t1 < t2 ? t2 : t1) < tMax) tMax = t1 < t2 ? t2 : t1;
+
+	if (tMin < 0.0f)
+		tMin = 0.0f;
+	if (tMax < tMin || (ray->hit && tMin > ray->bestDistance))
+		return -1.0f;
+	return tMin;
+}
+
+// Moller-Trumbore intersection. Both sides of the triangle are hit
+static void intersectTriangle(PickRay* ray, s32 x0, s32 y0, s32 x1, s32 y1, s32 x2, s32 y2)
+{
+	const FloatImageData* img = ray->img;
+	s32 c = img->channels;
+	const r32* p0 = &img->data[(y0 * img->width + x0) * c];
+	const r32* p1 = &img->data[(y1 * img->width + x1) * c];
+	const r32* p2 = &img->data[(y2 * img->width + x2) * c];
+
+	Vec3 e1 = (Vec3){p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+	Vec3 e2 = (Vec3){p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+	Vec3 d = ray->direction;
+	Vec3 p = (Vec3){d.y * e2.z - d.z * e2.y, d.z * e2.x - d.x * e2.z, d.x * e2.y - d.y * e2.x};
+	r32 determinant = e1.x * p.x + e1.y * p.y + e1.z * p.z;
+	if (determinant > -PICK_PARALLEL_EPSILON && determinant < PICK_PARALLEL_EPSILON)
+		return;
+
+	r32 inverseDeterminant = 1.0f / determinant;
+	Vec3 s = (Vec3){ray->origin.x - p0[0], ray->origin.y - p0[1], ray->origin.z - p0[2]};
+	r32 u = (s.x * p.x + s.y * p.y + s.z * p.z) * inverseDeterminant;
+	if (u < 0.0f || u > 1.0f)
+		return;
+
+	Vec3 q = (Vec3){s.y * e1.z - s.z * e1.y, s.z * e1.x - s.x * e1.z, s.x * e1.y - s.y * e1.x};
+	r32 v = (d.x * q.x + d.y * q.y + d.z * q.z) * inverseDeterminant;
+	if (v < 0.0f || u + v > 1.0f)
+		return;
+
+	r32 t = (e2.x * q.x + e2.y * q.y + e2.z * q.z) * inverseDeterminant;
+	if (t <= 0.0f || (ray->hit && t >= ray->bestDistance))
+		return;
+
+	PickResult* result = ray->result;
+	ray->hit = true;
+	ray->bestDistance = t;
+	result->vertices[0] = (DiscreteVec2){x0, y0};
+	result->vertices[1] = (DiscreteVec2){x1, y1};
+	result->vertices[2] = (DiscreteVec2){x2, y2};
+	result->barycentrics[0] = 1.0f - u - v;
+	result->barycentrics[1] = u;
+	result->barycentrics[2] = v;
+	result->distance = t;
+}
+
+static void intersectTile(PickRay* ray, s32 tx, s32 ty)
+{
+	const FloatImageData* img = ray->img;
+	s32 firstX = tx * PICK_TILE_SIZE, lastX = firstX + PICK_TILE_SIZE;
+	s32 firstY = ty * PICK_TILE_SIZE, lastY = firstY + PICK_TILE_SIZE;
+	if (lastX > img->width - 1) lastX = img->width - 1;
+	if (lastY > img->height - 1) lastY = img->height - 1;
+
+	// Same triangles as the grid meshes: (bottom left, top right, top left) and (bottom left, bottom right, top right)
+	for (s32 y = firstY; y < lastY; ++y)
+		for (s32 x = firstX; x < lastX; ++x)
+		{
+			intersectTriangle(ray, x, y, x + 1, y + 1, x, y + 1);
+			intersectTriangle(ray, x, y, x + 1, y, x + 1, y + 1);
+		}
+}
+
+// Children are visited from the closest box, so farther boxes are usually skipped after the first hit
+static void intersectNode(PickRay* ray, s32 level, s32 x, s32 y)
+{
+	if (level == 0)
+	{
+		intersectTile(ray, x, y);
+		return;
+	}
+
+	const PickPyramid* pyramid = ray->pyramid;
+	s32 childrenWidth = pyramid->levelWidths[level - 1];
+	s32 childrenHeight = pyramid->levelHeights[level - 1];
+	s32 childrenX[4], childrenY[4];
+	r32 childrenDistances[4];
+	s32 numberOfChildren = 0;
+
+	for (s32 cy = 2 * y; cy < 2 * y + 2 && cy < childrenHeight; ++cy)
+		for (s32 cx = 2 * x; cx < 2 * x + 2 && cx < childrenWidth; ++cx)
+		{
+			r32 distance = intersectBounds(ray, &pyramid->levels[level - 1][cy * childrenWidth + cx]);
+			if (distance < 0.0f)
+				continue;
+
+			s32 i = numberOfChildren++;
+			for (; i > 0 && childrenDistances[i - 1] > distance; --i)
+			{
+				childrenX[i] = childrenX[i - 1];
+				childrenY[i] = childrenY[i - 1];
+				childrenDistances[i] = childrenDistances[i - 1];
+			}
+			childrenX[i] = cx;
+			childrenY[i] = cy;
+			childrenDistances[i] = distance;
+		}
+
+	for (s32 i = 0; i < numberOfChildren; ++i)
+		if (!ray->hit || childrenDistances[i] <= ray->bestDistance)
+			intersectNode(ray, level - 1, childrenX[i], childrenY[i]);
+}
+
+// Finds the closest intersection of the ray <origin, direction> with the mesh of img, in the space of its positions.
+// The pyramid must be up to date with img. Returns false if the ray misses the mesh
+extern boolean pickCastRay(const PickPyramid* pyramid, const FloatImageData* img, Vec3 origin, Vec3 direction, PickResult* result)
+{
+	if (!pyramid->numberOfLevels)
+		return false;
+
+	PickRay ray = {0};
+	ray.pyramid = pyramid;
+	ray.img = img;
+	ray.origin = origin;
+	ray.direction = direction;
+	ray.inverseDirection.x = direction.x != 0.0f ? 1.0f / direction.x : PICK_HUGE;
+	ray.inverseDirection.y = direction.y != 0.0f ? 1.0f / direction.y : PICK_HUGE;
+	ray.inverseDirection.z = direction.z != 0.0f ? 1.0f / direction.z : PICK_HUGE;
+	ray.result = result;
+
+	s32 top = pyramid->numberOfLevels - 1;
+	if (intersectBounds(&ray, &pyramid->levels[top][0]) < 0.0f)
+		return false;
+	intersectNode(&ray, top, 0, 0);
+	if (!ray.hit)
+		return false;
+
+	s32 closest = 0;
+	for (s32 i = 1; i < 3; ++i)
+		if (result->barycentrics[i] > result->barycentrics[closest])
+			closest = i;
+	result->pixel = result->vertices[closest];
+	result->position = (Vec3){origin.x + result->distance * direction.x, origin.y + result->distance * direction.y,
+		origin.z + result->distance * direction.z};
+	return true;
+}
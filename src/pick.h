@@ -0,0 +1,54 @@
+#ifndef GIMMESH_PICK_H
+#define GIMMESH_PICK_H
+#include "graphics.h"
+
+// Side, in cells, of the tile of cells bounded by each box of the first level of a pick pyramid
+#define PICK_TILE_SIZE 8
+#define PICK_MAX_LEVELS 32
+
+typedef struct PickBounds PickBounds;
+typedef struct PickPyramid PickPyramid;
+typedef struct PickResult PickResult;
+
+struct PickBounds
+{
+	Vec3 min;
+	Vec3 max;
+};
+
+// Bounding boxes over the grid of a geometry image, used to cast rays against its mesh, see pickCastRay
+// Cell <x, y> is the quad between pixels <x, y> and <x + 1, y + 1>, which is split in two triangles by the diagonal from
+// <x, y> to <x + 1, y + 1>, like the meshes of graphicsMeshCreateFromGeometryImageWithColor. Box <x, y> of level 0 bounds
+// a tile of PICK_TILE_SIZE x PICK_TILE_SIZE cells and box <x, y> of level l + 1 bounds boxes <2x, 2y> to <2x + 1, 2y + 1>
+// of level l. The last level has a single box
+// A zero-initialized PickPyramid is a valid empty pyramid
+struct PickPyramid
+{
+	// Size of the geometry image
+	s32 width, height;
+	s32 numberOfLevels;
+	s32 levelWidths[PICK_MAX_LEVELS];
+	s32 levelHeights[PICK_MAX_LEVELS];
+	PickBounds* levels[PICK_MAX_LEVELS];
+};
+
+// Closest intersection of a ray with the mesh of a geometry image
+struct PickResult
+{
+	// Pixels of the vertices of the triangle that was hit
+	DiscreteVec2 vertices[3];
+	// Barycentric coordinates of the hit point, which is the sum of the vertices weighted by them
+	r32 barycentrics[3];
+	// Vertex of the triangle closest to the hit point
+	DiscreteVec2 pixel;
+	// The hit point is origin + distance * direction
+	r32 distance;
+	Vec3 position;
+};
+
+extern void pickPyramidUpdate(PickPyramid* pyramid, const FloatImageData* img);
+extern void pickPyramidUpdateRegion(PickPyramid* pyramid, const FloatImageData* img, s32 x, s32 y, s32 width, s32 height);
+extern void pickPyramidDestroy(PickPyramid* pyramid);
+extern boolean pickCastRay(const PickPyramid* pyramid, const FloatImageData* img, Vec3 origin, Vec3 direction, PickResult* result);
+
+#endif
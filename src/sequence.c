@@ -0,0 +1,227 @@
+#include "sequence.h"
+#include "domain_transform.h"
+#include "parallel.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Frame being filtered, or being prepared for the next filter, see prepareFrame
+typedef struct
+{
+	GeometryImage gim;
+	// Buffers owned by the frame, reused by every frame that goes through it
+	DomainTransform domainTransform;
+} SequenceFrame;
+
+typedef struct
+{
+	const s8* inputPattern;
+	const SequenceOptions* options;
+	BlurNormalsInformation blurNormalsInformation;
+	// Curvatures and normals of the last prepared frame. Only used by the thread that prepares the frames
+	DomainTransformSequence domainTransformSequence;
+	s32 width, height;
+	s64 numberOfDirtyRows;
+	// Frame prepared by prepareFrameThread and its result
+	SequenceFrame* nextFrame;
+	s32 nextFrameIndex;
+	s32 nextFrameResult;
+} SequencePipeline;
+
+// Patterns are used as printf formats, so they may only have one frame number conversion (%d, with an optional width such as
+// %04d) and no other conversion than %%
+static boolean isValidFramePattern(const s8* pattern)
+{
+	s32 numberOfConversions = 0;
+	for (const s8* c = pattern; *c; ++c)
+	{
+		if (*c != '%')
+			continue;
+		if (*++c == '%')
+			continue;
+		while (*c >= '0' && *c <= '9')
+			++c;
+		if (*c != 'd' || ++numberOfConversions > 1)
+			return false;
+	}
+	return true;
+}
+
+// The pattern must have been checked with isValidFramePattern
+static void getFramePath(s8* path, size_t size, const s8* pattern, s32 frameIndex)
+{
+	snprintf(path, size, pattern, frameIndex);
+}
+
+// Frames are numbered from 0 and end at the first missing file. A pattern without a frame number is a single frame
+static s32 countFrames(const s8* inputPattern)
+{
+	s8 path[1024], firstPath[1024];
+	s32 numberOfFrames = 0;
+	getFramePath(firstPath, sizeof(firstPath), inputPattern, 0);
+	for (;;)
+	{
+		getFramePath(path, sizeof(path), inputPattern, numberOfFrames);
+		if (numberOfFrames > 0 && !strcmp(path, firstPath))
+			return numberOfFrames;
+		FILE* file = fopen(path, "rb");
+		if (!file)
+			return numberOfFrames;
+		fclose(file);
+		++numberOfFrames;
+	}
+}
+
+// Calculates the domain transforms of the loaded frame, continuing from the domain transforms of the previous frame
+static void updateFrameDomainTransforms(SequencePipeline* pipeline, SequenceFrame* frame)
+{
+	gimEstimateNormals(&frame->gim);
+
+	dtSequenceUpdate(&pipeline->domainTransformSequence, frame->domainTransform, &frame->gim, pipeline->options->spatialFactor,
+		pipeline->options->rangeFactor, &pipeline->blurNormalsInformation, pipeline->options->normalThreshold);
+	pipeline->numberOfDirtyRows += pipeline->domainTransformSequence.numberOfDirtyRows;
+}
+
+// Loads a frame and calculates its domain transforms, see updateFrameDomainTransforms
+// On error, the geometry image of the frame is left empty
+static s32 prepareFrame(SequencePipeline* pipeline, SequenceFrame* frame, s32 frameIndex)
+{
+	s8 path[1024];
+	getFramePath(path, sizeof(path), pipeline->inputPattern, frameIndex);
+
+	frame->gim = (GeometryImage) {0};
+	if (gimParseGeometryImageFile(&frame->gim, (const u8*)path))
+		return -1;
+	if (frame->gim.img.width != pipeline->width || frame->gim.img.height != pipeline->height)
+	{
+		fprintf(stderr, "Error: frame %s does not have the size of the first frame\n", path);
+		gimFreeGeometryImage(&frame->gim);
+		frame->gim = (GeometryImage) {0};
+		return -1;
+	}
+
+	updateFrameDomainTransforms(pipeline, frame);
+	return 0;
+}
+
+static void* prepareFrameThread(void* data)
+{
+	SequencePipeline* pipeline = data;
+	pipeline->nextFrameResult = prepareFrame(pipeline, pipeline->nextFrame, pipeline->nextFrameIndex);
+	return 0;
+}
+
+// Filters the frames of an animation, inputPattern with frame numbers 0, 1, ... (e.g. "frame_%04d.gim"), until a frame
+// is missing, and writes each filtered frame to outputPattern with its number. All frames must have the same size
+// The normals are estimated from the positions, see gimEstimateNormals, so no mesh is built
+// One plan filters every frame and the domain transforms are updated incrementally, see dtSequenceUpdate. While a frame
+// is filtered, the next one is loaded and its domain transforms are calculated in another thread
+extern int sequenceFilterFiles(const s8* inputPattern, const s8* outputPattern, const SequenceOptions* options)
+{
+	if (!isValidFramePattern(inputPattern) || !isValidFramePattern(outputPattern))
+	{
+		fprintf(stderr, "Error: frame patterns may only have one frame number (e.g. %%04d) and no other %% than %%%%\n");
+		return -1;
+	}
+
+	s32 numberOfFrames = countFrames(inputPattern);
+	if (numberOfFrames == 0)
+	{
+		fprintf(stderr, "Error: no frames found for %s\n", inputPattern);
+		return -1;
+	}
+
+	GeometryImage firstGim = {0};
+	s8 path[1024];
+	getFramePath(path, sizeof(path), inputPattern, 0);
+	if (gimParseGeometryImageFile(&firstGim, (const u8*)path))
+		return -1;
+
+	SequencePipeline pipeline = {0};
+	pipeline.inputPattern = inputPattern;
+	pipeline.options = options;
+	pipeline.blurNormalsInformation = (BlurNormalsInformation) {options->blurNormals, filterGetNormalsBlurSS(options->rangeFactor)};
+	pipeline.width = firstGim.img.width;
+	pipeline.height = firstGim.img.height;
+
+	// Frames alternate between the two buffers
+	SequenceFrame frames[2] = {0};
+	for (s32 f = 0; f < 2; ++f)
+	{
+		frames[f].domainTransform.vertical = malloc(sizeof(r32) * pipeline.width * pipeline.height);
+		frames[f].domainTransform.horizontal = malloc(sizeof(r32) * pipeline.width * pipeline.height);
+	}
+
+	FilterPlanOptions planOptions = {options->numIterations, CURVATURE_FILTER, options->blurNormals};
+	FilterPlan plan = filterPlanCreate(pipeline.width, pipeline.height, &planOptions);
+	FilterParameters parameters = {options->spatialFactor, options->rangeFactor, pipeline.blurNormalsInformation.blurSS};
+
+	// The result is reused by all frames
+	GeometryImage filteredGim = {0};
+	filteredGim.img = graphicsFloatImageCopy(&firstGim.img);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	// The first frame was already loaded to know the size
+	frames[0].gim = firstGim;
+	updateFrameDomainTransforms(&pipeline, &frames[0]);
+	s32 result = 0;
+	s32 numberOfFilteredFrames = 0;
+
+	for (s32 f = 0; f < numberOfFrames && !result; ++f)
+	{
+		SequenceFrame* frame = &frames[f % 2];
+
+		pthread_t thread;
+		boolean isPreparing = false;
+		if (f + 1 < numberOfFrames)
+		{
+			pipeline.nextFrame = &frames[(f + 1) % 2];
+			pipeline.nextFrameIndex = f + 1;
+			if (pthread_create(&thread, 0, prepareFrameThread, &pipeline))
+				pipeline.nextFrameResult = prepareFrame(&pipeline, pipeline.nextFrame, pipeline.nextFrameIndex);
+			else
+				isPreparing = true;
+		}
+
+		if (filterExecuteWithDomainTransform(&plan, &frame->gim, &filteredGim, &parameters, &frame->domainTransform))
+			result = -1;
+		else
+		{
+			getFramePath(path, sizeof(path), outputPattern, f);
+			if (gimExportToGimFile(&filteredGim, path))
+				result = -1;
+			else
+				++numberOfFilteredFrames;
+		}
+		gimFreeGeometryImage(&frame->gim);
+
+		if (isPreparing)
+			pthread_join(thread, 0);
+		if (f + 1 < numberOfFrames)
+		{
+			if (result)
+				gimFreeGeometryImage(&pipeline.nextFrame->gim);
+			else
+				result = pipeline.nextFrameResult;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	r64 elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("\nSequence: %s (%dx%d), %d of %d frames filtered in %.2f seconds (%.2f frames per second) using %d threads\n",
+		inputPattern, pipeline.width, pipeline.height, numberOfFilteredFrames, numberOfFrames, elapsed, numberOfFilteredFrames / elapsed,
+		parallelGetNumberOfThreads());
+	if (numberOfFilteredFrames > 1)
+		printf("Rows of domain transforms recalculated per frame: %.1f of %d\n",
+			(r64)pipeline.numberOfDirtyRows / numberOfFilteredFrames, pipeline.height);
+
+	graphicsFloatImageFree(&filteredGim.img);
+	filterPlanDestroy(&plan);
+	dtSequenceDestroy(&pipeline.domainTransformSequence);
+	for (s32 f = 0; f < 2; ++f)
+		dtDeleteDomainTransforms(frames[f].domainTransform);
+
+	return result;
+}
@@ -0,0 +1,21 @@
+#ifndef GIMMESH_SEQUENCE_H
+#define GIMMESH_SEQUENCE_H
+#include "filter.h"
+
+typedef struct SequenceOptions SequenceOptions;
+
+// Options of a sequence filter. Every frame is filtered with the same parameters
+struct SequenceOptions
+{
+	s32 numIterations;
+	r32 spatialFactor;
+	r32 rangeFactor;
+	boolean blurNormals;
+	// A pixel keeps the domain transforms of the previous frame until its normal moves more than this distance, see
+	// dtSequenceUpdate. 0 calculates the domain transforms of every frame exactly
+	r32 normalThreshold;
+};
+
+extern int sequenceFilterFiles(const s8* inputPattern, const s8* outputPattern, const SequenceOptions* options);
+
+#endif
@@ -0,0 +1,235 @@
+#include "sweep.h"
+#include "filter.h"
+#include "domain_transform.h"
+#include "parallel.h"
+#include <dynamic_array.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Noise added to the reference when no noisy geometry image is given, see gimAddNoise
+#define SWEEP_NOISE_INTENSITY 0.5f
+#define SWEEP_NOISE_SEED 0
+
+static const r32 defaultSpatialFactors[] = {0.5f, 1.0f, 2.0f, 4.0f, 8.0f};
+static const r32 defaultRangeFactors[] = {0.25f, 0.5f, 1.0f, 2.0f};
+static const s32 defaultNumIterations[] = {1, 2, 3, 5};
+
+typedef struct
+{
+	const GeometryImage* referenceGim;
+	const GeometryImage* noisyGim;
+	const SweepGrid* grid;
+	SweepResult* results;
+} SweepJob;
+
+// Normal of an interior pixel, from the central differences of its neighbours. Returns <0, 0, 0> for degenerate pixels
+static Vec3 getPixelNormal(const FloatImageData* img, s32 x, s32 y)
+{
+	s32 c = img->channels;
+	const r32* left = &img->data[(y * img->width + x - 1) * c];
+	const r32* right = &img->data[(y * img->width + x + 1) * c];
+	const r32* down = &img->data[((y - 1) * img->width + x) * c];
+	const r32* up = &img->data[((y + 1) * img->width + x) * c];
+
+	Vec3 du = (Vec3){right[0] - left[0], right[1] - left[1], right[2] - left[2]};
+	Vec3 dv = (Vec3){up[0] - down[0], up[1] - down[1], up[2] - down[2]};
+	Vec3 normal = (Vec3){du.y * dv.z - du.z * dv.y, du.z * dv.x - du.x * dv.z, du.x * dv.y - du.y * dv.x};
+
+	r32 length = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+	if (length == 0.0f)
+		return (Vec3){0.0f, 0.0f, 0.0f};
+	return (Vec3){normal.x / length, normal.y / length, normal.z / length};
+}
+
+static void measureErrors(const FloatImageData* reference, const FloatImageData* filtered, SweepResult* result)
+{
+	s32 c = reference->channels;
+	r64 squaredDistances = 0.0;
+	for (s32 i = 0; i < reference->width * reference->height; ++i)
+	{
+		r64 dx = filtered->data[i * c + 0] - reference->data[i * c + 0];
+		r64 dy = filtered->data[i * c + 1] - reference->data[i * c + 1];
+		r64 dz = filtered->data[i * c + 2] - reference->data[i * c + 2];
+		squaredDistances += dx * dx + dy * dy + dz * dz;
+	}
+	result->rmsVertexError = (r32)sqrt(squaredDistances / (reference->width * reference->height));
+
+	// The border is skipped: its neighbours are in the mirrored part of the image
+	r64 angles = 0.0;
+	s32 numberOfAngles = 0;
+	for (s32 y = 1; y < reference->height - 1; ++y)
+		for (s32 x = 1; x < reference->width - 1; ++x)
+		{
+			Vec3 referenceNormal = getPixelNormal(reference, x, y);
+			Vec3 filteredNormal = getPixelNormal(filtered, x, y);
+			r32 cosine = referenceNormal.x * filteredNormal.x + referenceNormal.y * filteredNormal.y + referenceNormal.z * filteredNormal.z;
+			if (cosine > 1.0f) cosine = 1.0f;
+			if (cosine < -1.0f) cosine = -1.0f;
+			angles += acosf(cosine);
+			++numberOfAngles;
+		}
+	result->normalAngleError = numberOfAngles ? (r32)(angles / numberOfAngles) * (180.0f / PI_F) : 0.0f;
+}
+
+// Each group is a (spatial factor, range factor) pair. Its domain transforms are calculated once and shared by the
+// executions with different numbers of iterations
+static void filterGroups(s32 firstGroup, s32 lastGroup, void* data)
+{
+	SweepJob* job = data;
+	const SweepGrid* grid = job->grid;
+	const GeometryImage* noisyGim = job->noisyGim;
+
+	GeometryImage filteredGim = {0};
+	filteredGim.img = graphicsFloatImageCopy(&noisyGim->img);
+
+	// Plans only depend on the size and the options, so each number of iterations has one plan for all groups
+	FilterPlan* plans = malloc(sizeof(FilterPlan) * grid->numberOfNumIterations);
+	for (s32 i = 0; i < grid->numberOfNumIterations; ++i)
+	{
+		FilterPlanOptions options = {grid->numIterations[i], CURVATURE_FILTER, true};
+		plans[i] = filterPlanCreate(noisyGim->img.width, noisyGim->img.height, &options);
+	}
+
+	for (s32 group = firstGroup; group < lastGroup; ++group)
+	{
+		r32 spatialFactor = grid->spatialFactors[group / grid->numberOfRangeFactors];
+		r32 rangeFactor = grid->rangeFactors[group % grid->numberOfRangeFactors];
+
+		BlurNormalsInformation blurNormalsInformation = {true, filterGetNormalsBlurSS(rangeFactor)};
+		DomainTransform domainTransform = dtGenerateDomainTransforms(noisyGim, spatialFactor, rangeFactor, &blurNormalsInformation);
+		FilterParameters parameters = {spatialFactor, rangeFactor, blurNormalsInformation.blurSS};
+
+		for (s32 i = 0; i < grid->numberOfNumIterations; ++i)
+		{
+			filterExecuteWithDomainTransform(&plans[i], noisyGim, &filteredGim, &parameters, &domainTransform);
+
+			SweepResult* result = &job->results[group * grid->numberOfNumIterations + i];
+			result->spatialFactor = spatialFactor;
+			result->rangeFactor = rangeFactor;
+			result->numIterations = grid->numIterations[i];
+			measureErrors(&job->referenceGim->img, &filteredGim.img, result);
+		}
+
+		dtDeleteDomainTransforms(domainTransform);
+	}
+
+	for (s32 i = 0; i < grid->numberOfNumIterations; ++i)
+		filterPlanDestroy(&plans[i]);
+	free(plans);
+	graphicsFloatImageFree(&filteredGim.img);
+}
+
+static void markParetoFront(SweepResult* results)
+{
+	s32 numberOfResults = array_get_length(results);
+	for (s32 i = 0; i < numberOfResults; ++i)
+	{
+		results[i].isParetoOptimal = true;
+		for (s32 j = 0; j < numberOfResults; ++j)
+		{
+			boolean notWorse = results[j].rmsVertexError <= results[i].rmsVertexError &&
+				results[j].normalAngleError <= results[i].normalAngleError;
+			boolean better = results[j].rmsVertexError < results[i].rmsVertexError ||
+				results[j].normalAngleError < results[i].normalAngleError;
+			if (notWorse && better)
+			{
+				results[i].isParetoOptimal = false;
+				break;
+			}
+		}
+	}
+}
+
+// Filters noisyGim in CURVATURE_FILTER mode, with blurred normals, with every combination of the parameters of the grid
+// and compares each result with referenceGim. noisyGim must have its normals calculated (see gimEstimateNormals)
+// and the size of referenceGim. Groups of executions run in parallel.
+// Returns a dynamic array with one result per combination, ordered by spatial factor, range factor and iterations
+extern SweepResult* sweepRun(const GeometryImage* referenceGim, const GeometryImage* noisyGim, const SweepGrid* grid)
+{
+	s32 numberOfGroups = grid->numberOfSpatialFactors * grid->numberOfRangeFactors;
+	SweepResult* results = array_create(SweepResult, numberOfGroups * grid->numberOfNumIterations);
+	array_allocate(results, numberOfGroups * grid->numberOfNumIterations);
+
+	SweepJob job = {referenceGim, noisyGim, grid, results};
+	parallelFor(numberOfGroups, 1, filterGroups, &job);
+
+	markParetoFront(results);
+	return results;
+}
+
+static int compareRmsVertexError(const void* a, const void* b)
+{
+	r32 errorA = ((const SweepResult*)a)->rmsVertexError;
+	r32 errorB = ((const SweepResult*)b)->rmsVertexError;
+	return (errorA > errorB) - (errorA < errorB);
+}
+
+// Runs a sweep with the default grid and prints all results and the Pareto front. When noisyPath is 0, the noisy geometry
+// image is the reference with deterministic noise
+extern int sweepRunFromFiles(const s8* referencePath, const s8* noisyPath)
+{
+	GeometryImage referenceGim = {0};
+	GeometryImage noisyGim = {0};
+
+	if (gimParseGeometryImageFile(&referenceGim, (const u8*)referencePath))
+		return -1;
+
+	if (noisyPath)
+	{
+		if (gimParseGeometryImageFile(&noisyGim, (const u8*)noisyPath))
+		{
+			gimFreeGeometryImage(&referenceGim);
+			return -1;
+		}
+		if (noisyGim.img.width != referenceGim.img.width || noisyGim.img.height != referenceGim.img.height)
+		{
+			fprintf(stderr, "Error: the noisy geometry image must have the size of the reference\n");
+			gimFreeGeometryImage(&referenceGim);
+			gimFreeGeometryImage(&noisyGim);
+			return -1;
+		}
+	}
+	else
+		noisyGim = gimAddNoise(&referenceGim, SWEEP_NOISE_INTENSITY, SWEEP_NOISE_SEED);
+	gimEstimateNormals(&noisyGim);
+
+	SweepGrid grid = {
+		defaultSpatialFactors, sizeof(defaultSpatialFactors) / sizeof(r32),
+		defaultRangeFactors, sizeof(defaultRangeFactors) / sizeof(r32),
+		defaultNumIterations, sizeof(defaultNumIterations) / sizeof(s32)
+	};
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	SweepResult* results = sweepRun(&referenceGim, &noisyGim, &grid);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	r64 elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	s32 numberOfResults = array_get_length(results);
+	printf("\nSweep: %s (%dx%d), %d combinations in %.2f seconds using %d threads\n", referencePath, referenceGim.img.width,
+		referenceGim.img.height, numberOfResults, elapsed, parallelGetNumberOfThreads());
+	printf("%10s %10s %10s %14s %14s %8s\n", "ss", "sr", "n", "rms error", "angle error", "pareto");
+	for (s32 i = 0; i < numberOfResults; ++i)
+		printf("%10.3f %10.3f %10d %14.6g %14.4f %8s\n", results[i].spatialFactor, results[i].rangeFactor, results[i].numIterations,
+			results[i].rmsVertexError, results[i].normalAngleError, results[i].isParetoOptimal ? "*" : "");
+
+	// Pareto front, from the best vertex error to the best normal error
+	SweepResult* front = array_create(SweepResult, numberOfResults);
+	for (s32 i = 0; i < numberOfResults; ++i)
+		if (results[i].isParetoOptimal)
+			array_push(front, &results[i]);
+	qsort(front, array_get_length(front), sizeof(SweepResult), compareRmsVertexError);
+
+	printf("\nPareto front (rms error vs angle error):\n");
+	for (u32 i = 0; i < array_get_length(front); ++i)
+		printf("\tss = %.3f, sr = %.3f, n = %d: rms error = %g, angle error = %.4f degrees\n", front[i].spatialFactor,
+			front[i].rangeFactor, front[i].numIterations, front[i].rmsVertexError, front[i].normalAngleError);
+
+	array_release(front);
+	array_release(results);
+	gimFreeGeometryImage(&noisyGim);
+	gimFreeGeometryImage(&referenceGim);
+	return 0;
+}
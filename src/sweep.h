@@ -0,0 +1,35 @@
+#ifndef GIMMESH_SWEEP_H
+#define GIMMESH_SWEEP_H
+#include "gim.h"
+
+typedef struct SweepGrid SweepGrid;
+typedef struct SweepResult SweepResult;
+
+// Values of each filter parameter. Every combination is filtered
+struct SweepGrid
+{
+	const r32* spatialFactors;
+	s32 numberOfSpatialFactors;
+	const r32* rangeFactors;
+	s32 numberOfRangeFactors;
+	const s32* numIterations;
+	s32 numberOfNumIterations;
+};
+
+struct SweepResult
+{
+	r32 spatialFactor;
+	r32 rangeFactor;
+	s32 numIterations;
+	// Root mean square of the distance between the filtered and the reference vertices
+	r32 rmsVertexError;
+	// Mean angle, in degrees, between the normals of the filtered and of the reference geometry images
+	r32 normalAngleError;
+	// No other result has smaller or equal errors with at least one of them smaller
+	boolean isParetoOptimal;
+};
+
+extern SweepResult* sweepRun(const GeometryImage* referenceGim, const GeometryImage* noisyGim, const SweepGrid* grid);
+extern int sweepRunFromFiles(const s8* referencePath, const s8* noisyPath);
+
+#endif
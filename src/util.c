@@ -8,6 +8,23 @@ extern r32 utilRandomFloat(r32 min, r32 max)
 	return min + scale * (max - min);
 }
 
+// Counter-based random numbers: the value depends only on (seed, counter), so values can be generated in any order and
+// from any thread. It is the output of a SplitMix64 generator seeded with 'seed' after 'counter' steps
+extern u64 utilCounterRandom(u64 seed, u64 counter)
+{
+	u64 x = seed + (counter + 1) * 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+// Maps the upper 24 bits of 'bits' to [min, max)
+extern r32 utilBitsToFloat(u32 bits, r32 min, r32 max)
+{
+	r32 scale = (bits >> 8) * (1.0f / 16777216.0f);
+	return min + scale * (max - min);
+}
+
 extern s8* utilReadFile(const s8* path, s32* _fileLength)
 {
 	FILE* file;
@@ -5,5 +5,7 @@
 extern s8* utilReadFile(const s8* path, s32* fileLength);
 extern void utilFreeFile(s8* file);
 extern r32 utilRandomFloat(r32 min, r32 max);
+extern u64 utilCounterRandom(u64 seed, u64 counter);
+extern r32 utilBitsToFloat(u32 bits, r32 min, r32 max);
 
 #endif
\ No newline at end of file